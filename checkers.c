@@ -39,11 +39,22 @@
 */
 
 /* header files --------------------------------------------------------------*/
+#define _POSIX_C_SOURCE 200809L     // clock_gettime, getline
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
 #include <assert.h>
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* given global constants ----------------------------------------------------*/
 #define BOARD_SIZE          8       // board size
@@ -67,17 +78,180 @@
 #define PLAY                'P'         // input command to play 10 moves
 #define ACTION              'A'         // input command to play 1 move
 #define MAX_PIECE_MOVES     2           // max possible moves of a piece
-#define MAX_TOWER_MOVES     4           // max possible moves of a tower
 #define QUAD1               1           // 1st quadrant (top right)
 #define QUAD2               2           // 2nd quadrant (bottom right)
 #define QUAD3               3           // 3rd quadrant (bottom left)
 #define QUAD4               4           // 4th quadrant (top left)
+#define QUADS               4           // number of quadrants
+
+/* bitboard constants --------------------------------------------------------*/
+#define SQUARES             32          // dark (playable) squares on the board
+#define SQUARES_PER_ROW     (COLS / 2)  // dark squares in each row
+#define EVEN_ROWS           0x0F0F0F0Fu // squares on rows 1, 3, 5, 7
+#define ODD_ROWS            0xF0F0F0F0u // squares on rows 2, 4, 6, 8
+#define RIGHT_EDGE          0x08080808u // squares on column H
+#define LEFT_EDGE           0x10101010u // squares on column A
+#define TOP_ROW             0x0000000Fu // squares on row 1 (black towers)
+#define BOTTOM_ROW          0xF0000000u // squares on row 8 (white towers)
+#define ALL_SQUARES         0xFFFFFFFFu // every dark square
+#define PIECE_TYPES         4           // kinds of piece on the board
+#define TYPE_BPIECE         0           // black piece material index
+#define TYPE_BTOWER         1           // black tower material index
+#define TYPE_WPIECE         2           // white piece material index
+#define TYPE_WTOWER         3           // white tower material index
+#define NO_SQUARE           (-1)        // no square, e.g. nothing captured
+
+/* bitboard macros -----------------------------------------------------------*/
+#define SQUARE(row, col)    ((row) * SQUARES_PER_ROW + (col) / 2)
+#define SQ_ROW(sq)          ((sq) / SQUARES_PER_ROW)
+#define SQ_COL(sq)          (2 * ((sq) % SQUARES_PER_ROW) + !(SQ_ROW(sq) % 2))
+#define SQ_BIT(sq)          ((bits_t)1 << (sq))
+#define OPPOSITE(quad)      (((quad) + 1) % QUADS + 1)
+
+/* search constants ----------------------------------------------------------*/
+#define ARENA_BLOCK_SIZE    65536       // bytes in each arena block
+#define ARENA_ALIGN         8           // alignment of arena allocations
+#define OPT_MEMORY          "-m"        // option to report arena usage
+#define OPT_HASH            "-H"        // option to size hash table (MB)
+#define OPT_STATS           "-s"        // option to report search statistics
+#define OPT_DEPTH           "-d"        // option to set search depth
+#define OPT_TIME            "-t"        // option to set time per move (ms)
+#define MAX_DEPTH           64          // deepest iterative deepening search
+#define TIME_CHECK_MASK     1023        // nodes between clock checks, minus 1
+#define OPT_NO_ORDER        "-n"        // option to search moves unordered
+#define OPT_QUIESCE         "-Q"        // option to play out captures at leaves
+#define OPT_FULL_WINDOW     "-V"        // option to search without PVS windows
+#define ASPIRATION_WINDOW   2           // root window either side of last cost
+#define MAX_CAPTURES        (2 * INITIAL_TEAM_PIECES)   // no game has more
+#define OPT_THREADS         "-j"        // option to set search threads
+#define OPT_LAZY            "-l"        // option to use lazy SMP threads
+#define OPT_EFFICIENCY      "-E"        // option to measure thread speedup
+#define MAX_THREADS         256         // most search threads allowed
+#define OPT_BATCH           "-b"        // option to analyse a file of games
+#define MAX_LINE            256         // longest line read from a batch file
+#define OPT_PERFT           "-p"        // option to count leaves to a depth
+#define OPT_BENCH           "-B"        // option to run the perft benchmark
+#define BENCH_POSITIONS     4           // positions in the perft benchmark
+#define OPT_JSON            "-J"        // option to write per move JSON stats
+#define OPT_MATCH           "-M"        // option to play a tournament
+#define OPENING_PLIES       6           // random moves opening each game pair
+#define MAX_GAME_PLIES      300         // tournament games reaching this draw
+
+/* output constants ----------------------------------------------------------*/
+#define OPT_COMPACT         "-c"        // option to print one line per move
+#define OPT_SILENT          "-q"        // option to print only the result
+#define OUTPUT_FULL         0           // boards and move details
+#define OUTPUT_COMPACT      1           // one line per move, no boards
+#define OUTPUT_SILENT       2           // last move and result only
+#define BOARD_TEXT          1024        // bytes to render one board
+#define ROW_SEPARATOR       "   +---+---+---+---+---+---+---+---+\n"
+
+/* input constants -----------------------------------------------------------*/
+#define OPT_INPUT           "-i"        // option to read moves from a file
+#define OPT_POSITION        "-P"        // option to start from a position
+#define OPT_FINAL           "-F"        // option to print the final position
+#define POSITION_TEXT       54          // 39 squares and slashes, " b ", any
+                                        // int action number and NUL
+#define MAX_ACTION_NUM      65535       // highest action number in a position
+#define ACTION_NUM_DIGITS   "5"         // sscanf width of MAX_ACTION_NUM
+#define ROW_DELIM           '/'         // between rows of a position string
+#define SIDE_BLACK          'b'         // black to move in a position string
+#define SIDE_WHITE          'w'         // white to move in a position string
+#define INPUT_BLOCK         65536       // bytes read from a stream at once
+
+/* game record constants -----------------------------------------------------*/
+#define OPT_WRITE           "-w"        // option to write the game as a record
+#define OPT_CONVERT         "-x"        // option to convert text and records
+#define RECORD_MAGIC        "CKR1"      // first bytes of a binary game record
+#define RECORD_MAGIC_LEN    4
+#define RECORD_HEADER       12          // magic, flags, command, result, moves
+#define RECORD_POSITION     14          // three bitboards and a move number
+#define RECORD_HAS_POSITION 1           // flag for a non-standard start
+#define RECORD_MAX_MOVE_NUM 0xFFFF      // most moves made a record can hold
+#define RESULT_NONE         0           // game not decided
+#define RESULT_BLACK_WIN    1
+#define RESULT_WHITE_WIN    2
+
+/* engine constants ----------------------------------------------------------*/
+#define OPT_ENGINE          "-e"        // option to answer commands on stdin
+#define CMD_NEW             "new"       // back to the starting board
+#define CMD_MOVES           "moves"     // apply moves to the position
+#define CMD_GO              "go"        // search the position
+#define CMD_STOP            "stop"      // end the search with its best move
+#define CMD_BOARD           "board"     // print the position
+#define CMD_POSITION        "position"  // set the position from a string
+#define CMD_QUIT            "quit"      // leave the engine
+#define GO_DEPTH            "depth"     // go option to set search depth
+#define GO_TIME             "time"      // go option to set time (ms)
+#define CMD_DELIMS          " \t\r\n"  // characters between command words
+
+/* endgame table constants ---------------------------------------------------*/
+#define OPT_TABLES          "-T"        // option to probe endgame tables
+#define OPT_BUILD_TABLES    "-G"        // option to generate endgame tables
+#define TB_MAGIC            "CKTB"      // first bytes of an endgame table file
+#define TB_MAGIC_LEN        4
+#define TB_HEADER           8           // magic and most pieces in a position
+#define TB_MAX_PIECES       4           // most pieces tables can be built for
+#define TB_DRAW             0           // neither side can force a win
+#define TB_LOSS             128         // added to the moves until a loss
+#define TB_MAX_MOVES        127         // longer distances are stored as this
+#define TB_WIN_AT(n)        (((n) << 1) | 1)    // generator's win in n moves
+#define TB_LOSS_AT(n)       (((n) + 1) << 1)    // generator's loss in n moves
+#define TB_MOVES(solved)    (((solved) >> 1) - !((solved) & 1))
+
+/* opening book constants ----------------------------------------------------*/
+#define OPT_BOOK            "-k"        // option to play from an opening book
+#define OPT_BUILD_BOOK      "-K"        // option to build an opening book
+#define BOOK_MAGIC          "CKB1"      // first bytes of an opening book file
+#define BOOK_MAGIC_LEN      4
+#define BOOK_HEADER         8           // magic and number of entries
+#define BOOK_ENTRY          16          // key, cost, move, depth, padding
+#define BOOK_DEPTH          12          // default depth of book searches
+
+/* move ordering constants ---------------------------------------------------*/
+#define MAX_PLY             128         // deepest ply with killer moves
+#define KILLERS             2           // killer moves kept per ply
+#define PACKED_MOVES        256         // number of one byte packed moves
+#define ORDER_HASH          (1 << 30)   // score of the hash table move
+#define ORDER_CAPTURE       (1 << 29)   // score of a capture
+#define ORDER_PROMOTE       (1 << 28)   // score of a piece becoming a tower
+#define ORDER_KILLER        (1 << 27)   // score of the first killer move
+#define ORDER_HISTORY_MAX   ((1 << 26) - 1) // highest history score
+#define ORDER_DONE          INT_MIN     // score of an already searched move
+
+/* transposition table constants ---------------------------------------------*/
+#define TT_DEFAULT_MB       16          // default hash table size
+#define MEGABYTE            (1024 * 1024)
+#define TT_NONE             0           // empty entry
+#define TT_EXACT            1           // score is the exact cost
+#define TT_LOWER            2           // score is a lower bound (fail high)
+#define TT_UPPER            3           // score is an upper bound (fail low)
+#define TT_NO_MOVE          0x00        // no move: B1 stepping off the board
+#define ZOBRIST_SEED        0x9E3779B97F4A7C15u
 
 /* given type definitions ----------------------------------------------------*/
 typedef char board_t[BOARD_SIZE][BOARD_SIZE];  // board type
 
 /* my type definitions -------------------------------------------------------*/
 
+typedef uint32_t bits_t;            // one bit per dark square
+
+typedef struct {                    // position as dark square bitboards
+    bits_t black, white, towers;
+    uint8_t material[PIECE_TYPES];  // pieces of each type, kept by moves
+} bitboard_t;
+
+typedef struct {                    // one step towards a quadrant, by rows
+    bits_t even_keep, odd_keep;     // squares the step keeps on the board
+    int even_shift, odd_shift;      // bits moved up (positive) or down
+} quad_shift_t;
+
+typedef struct {                    // what a move changed, to take it back
+    int8_t src, tgt, cpt;           // squares moved from, to and captured
+    int8_t mover, captured;         // material indices before the move
+    int8_t promoted;
+} undo_t;
+
 typedef struct {                    // coordinate of a cell
     int row, col;
     char cell;
@@ -90,54 +264,473 @@ typedef struct {                    // move from source cell to target cell
 
 typedef struct {
     move_t *moves_arr;
-    int n_moves, max_moves;
+    int n_moves;
 } moveset_t;
 
 typedef struct node node_t;         // tree node prototype
 
-struct node {                       // minimax tree node
+struct node {                       // node on the current search path
+    bitboard_t *bits;               // board shared along the path
+    uint64_t hash;
+    move_t move, best_move;
+    int cost, max_depth, num_children;
+};
+
+typedef struct arena_block arena_block_t;
+
+struct arena_block {                // one chunk of arena memory
+    arena_block_t *next;
+    size_t size, used;
+    char data[];
+};
+
+typedef struct {                    // bump allocator released in one go
+    arena_block_t *first, *cur;
+    size_t used, high_water;
+    unsigned long allocs;
+} arena_t;
+
+typedef struct {                    // arena position to rewind back to
+    arena_block_t *block;
+    size_t block_used, used;
+} arena_mark_t;
+
+typedef struct {                    // one stored search result
+    uint64_t key;
+    int32_t score;
+    int8_t depth;
+    uint8_t bound, age, move;
+} tt_entry_t;
+
+typedef struct {                    // table slot, shared between threads
+    _Atomic uint64_t check;         // key xor data, catches torn writes
+    _Atomic uint64_t data;          // entry packed by tt_pack_entry
+} tt_slot_t;
+
+typedef struct {                    // transposition table usage counters
+    unsigned long probes, hits, cutoffs, collisions;
+    unsigned long stores, replacements, skipped;
+    unsigned long reused;           // hits stored by an earlier move's search
+} tt_stats_t;
+
+typedef struct {                    // hash table of searched positions
+    tt_slot_t *slots;
+    uint64_t mask;
+    uint64_t keys[PIECE_TYPES][SQUARES], white_key;
+    uint8_t age;
+    int exact_depth;
+    tt_stats_t stats;
+} tt_t;
+
+typedef struct {                    // whole input held in memory
+    char *text;
+    size_t length, pos;             // bytes held, start of the next line
+    int line_num, mapped;           // lines split off, text is a mapped file
+} input_t;
+
+typedef struct {                    // game as a binary record
+    int has_position;               // starts from bits and move_num, not
+    bitboard_t bits;                // the standard starting board
+    int move_num;
+    char command;
+    int result;
+    uint8_t *moves;                 // moves packed by tt_pack_move
+    int n_moves, max_moves;
+} record_t;
+
+typedef struct {                    // endgame tables, mapped from a file
+    uint8_t *map;                   // whole file, results after the header
+    size_t map_size;
+    int max_pieces;
+    uint64_t offsets[TB_MAX_PIECES + 2];    // first index of each piece count
+    uint32_t choose[SQUARES + 1][TB_MAX_PIECES + 1];
+} tb_t;
+
+typedef struct {                    // opening book, mapped from a file
+    uint8_t *map;                   // whole file, entries sorted by key
+    size_t map_size;
+    uint32_t n_entries;
+} book_t;
+
+typedef struct {                    // position found while building a book
+    uint64_t key;
+    bitboard_t bits;
+    int move_num;
+} book_position_t;
+
+typedef struct {                    // how moves and boards are printed
+    int mode;
+    char last[MAX_LINE];            // silent mode's latest move, or empty
+    record_t *record;               // record of the game being written
+} output_t;
+
+typedef struct search search_t;
+
+struct search {                     // settings and memory used by searches
+    arena_t arena;
+    tt_t tt;
+    tb_t tb;
+    book_t book;
+    int depth, report_memory, report_stats;
+    long time_budget, start_ms;
+    int can_stop, stopped;
+    unsigned long nodes;
+    int order_moves;
+    uint8_t killers[MAX_PLY][KILLERS];
+    int history[2][PACKED_MOVES];
+    unsigned long cutoffs, first_cutoffs;
+    unsigned long expanded, leaves;  // nodes given children, nodes evaluated
+    unsigned long tb_hits;          // nodes whose result the tables gave
+    int quiesce_plies;              // captures played out at leaves, or 0
+    unsigned long quiesce_nodes;    // positions visited playing them out
+    int pvs;                        // null windows after each first move
+    unsigned long researches;       // null window moves searched again
+    unsigned long aspiration_fails; // root windows the cost fell outside
+    int book_move;                  // last move came from the opening book
+    long generate_ns, evaluate_ns;  // time in move generation and cost
+    FILE *json;                     // per move statistics stream, or NULL
+    output_t output;
+    char *input_file;               // file of moves to read, or NULL for stdin
+    char *record_file;              // file to write the game to, or NULL
+    char *position;                 // position string to start from, or NULL
+    int print_final;
+    int convert;
+    int n_threads, lazy_smp, measure_efficiency, completed_depth;
+    int reused_depth;               // iterations known before searching
+    search_t *workers;              // per thread searches for split search
+    char *batch_file;               // file of games to analyse, or NULL
+    int perft_depth, bench;
+    atomic_int *halt;               // set to stop a lazy SMP helper
+    atomic_int *stop;               // set by the engine to end the search
+    atomic_int *root_bound;         // split root's best cost so far, or NULL
+    int engine;
+    char *tables_file;              // endgame tables to generate, or NULL
+    int table_pieces;
+    char *book_file;                // opening book to build, or NULL
+    int book_plies;
+    int match_games;                // games of a tournament, or 0
+    char *match_specs[2];           // the two sides' settings
+};
+
+typedef struct {                    // root moves shared by split workers
+    node_t *root;
+    moveset_t *moveset;
+    int *order;                     // move indices, most promising first
+    int depth, black;
+    atomic_int next;                // next entry of order to hand out
+    pthread_mutex_t lock;           // guards cost and best_index together
+    int cost, best_index;
+    atomic_int bound;               // copy of cost read without the lock
+} split_t;
+
+typedef struct {                    // one game of a batch and its result
+    move_t *moves;                  // input moves, cells filled on replay
+    int n_moves, max_moves;
+    char command;                   // ACTION, PLAY or none
+    int has_position, move_num;     // starts from bits, not the start board
+    bitboard_t bits;
+    int n_actions, error, cost, n_played;
+    move_t played[COMP_ACTIONS];    // moves chosen by the search
+    int done;
+} game_t;
+
+typedef struct {                    // games shared by batch threads
+    game_t *games;
+    int n_games;
+    atomic_int next;                // next game to hand out
+    pthread_mutex_t lock;           // guards the games' done flags
+    pthread_cond_t finished;        // signalled whenever a game is done
+} batch_t;
+
+typedef struct {                    // one side of a tournament and its totals
+    char *spec;                     // settings as given, such as d5t100n
+    int depth, order_moves, tables, book, quiesce_plies;
+    long time_budget;
+    unsigned long wins, draws, losses, moves, nodes;
+    long search_ns;
+} player_t;
+
+typedef struct {                    // games shared by tournament threads
+    search_t *search;               // settings, tables and book to copy
+    player_t players[2];
+    int n_games;
+    size_t hash_mb;
+    atomic_int next;                // next game to hand out
+    pthread_mutex_t lock;           // guards the players' totals
+} tournament_t;
+
+typedef struct {                    // one thread of a split search or batch
+    search_t *search;
+    split_t *split;
+    batch_t *batch;
+    tournament_t *tournament;
+    bitboard_t bits;                // the thread's own copy of the board
+    node_t root;                    // lazy SMP helper's copy of the root
+    int depth;                      // lazy SMP helper's search depth
+    pthread_t thread;
+} worker_t;
+
+typedef struct {                    // position kept by a persistent engine
+    search_t *search;
     board_t board;
-    move_t move;
-    int cost, temp_cost, propagated_cost, max_depth;
-    int num_children, best_child;
-    node_t **children;
+    bitboard_t bits;
+    move_t move;                    // last move played, numbering the turn
+    node_t root;
+    int depth, exact_depth;         // settings restored after each go
+    long time_budget;
+    atomic_int stop;
+    int searching;
+    pthread_t thread;
+} engine_t;
+
+typedef struct {                    // reference position for the benchmark
+    const char *moves;              // moves from the start that reach it
+    int depth;
+    unsigned long leaves;           // known leaf count at that depth
+} bench_t;
+
+
+/* perft benchmark positions -------------------------------------------------*/
+
+static const bench_t bench_positions[BENCH_POSITIONS] = {
+    {"", 9, 109895943},
+    {"G6-F5 H3-G4 F5-H3 F3-G4 E6-F5 G4-E6 D7-F5 G2-F3 F7-G6 F1-G2", 8, 
+        28343712},
+    {"G6-F5 H3-G4 F5-H3 F3-G4 E6-F5 G4-E6 D7-F5 G2-F3 F7-G6 F1-G2 H3-F1 "
+        "B3-C4 F1-G2 F3-G4 G2-H3 A2-B3 F5-E4 E2-F3 H3-F5 H1-G2", 8, 43094750},
+    {"G6-F5 H3-G4 F5-H3 F3-G4 E6-F5 G4-E6 D7-F5 G2-F3 F7-G6 F1-G2 H3-F1 "
+        "B3-C4 F1-G2 F3-G4 G2-H3 A2-B3 F5-E4 E2-F3 H3-F5 H1-G2 F5-E6 B1-A2 "
+        "C6-D5 D1-E2 G6-F5 B3-A4 D5-B3 A2-C4 B7-C6 C4-D5", 8, 38620737},
+};
+
+
+/* move geometry tables ------------------------------------------------------*/
+
+/* shift_quad's step towards each quadrant, for rows 1, 3, 5, 7 and 2, 4, 6, 8
+*/
+static const quad_shift_t quad_shifts[QUADS] = {
+    {EVEN_ROWS & ~RIGHT_EDGE, ODD_ROWS, -3, -4},
+    {EVEN_ROWS & ~RIGHT_EDGE, ODD_ROWS, 5, 4},
+    {EVEN_ROWS, ODD_ROWS & ~LEFT_EDGE, 4, 3},
+    {EVEN_ROWS, ODD_ROWS & ~LEFT_EDGE, -4, -5},
+};
+
+/* square reached by one step and by a capture towards each quadrant, -1
+   (NO_SQUARE) if off the board; a capture jumps the step's square
+*/
+static const int8_t step_squares[QUADS][SQUARES] = {
+    {-1, -1, -1, -1,  0,  1,  2,  3,
+      5,  6,  7, -1,  8,  9, 10, 11,
+     13, 14, 15, -1, 16, 17, 18, 19,
+     21, 22, 23, -1, 24, 25, 26, 27},
+    { 5,  6,  7, -1,  8,  9, 10, 11,
+     13, 14, 15, -1, 16, 17, 18, 19,
+     21, 22, 23, -1, 24, 25, 26, 27,
+     29, 30, 31, -1, -1, -1, -1, -1},
+    { 4,  5,  6,  7, -1,  8,  9, 10,
+     12, 13, 14, 15, -1, 16, 17, 18,
+     20, 21, 22, 23, -1, 24, 25, 26,
+     28, 29, 30, 31, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1,  0,  1,  2,
+      4,  5,  6,  7, -1,  8,  9, 10,
+     12, 13, 14, 15, -1, 16, 17, 18,
+     20, 21, 22, 23, -1, 24, 25, 26}
+};
+
+static const int8_t jump_squares[QUADS][SQUARES] = {
+    {-1, -1, -1, -1, -1, -1, -1, -1,
+      1,  2,  3, -1,  5,  6,  7, -1,
+      9, 10, 11, -1, 13, 14, 15, -1,
+     17, 18, 19, -1, 21, 22, 23, -1},
+    { 9, 10, 11, -1, 13, 14, 15, -1,
+     17, 18, 19, -1, 21, 22, 23, -1,
+     25, 26, 27, -1, 29, 30, 31, -1,
+     -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1,  8,  9, 10, -1, 12, 13, 14,
+     -1, 16, 17, 18, -1, 20, 21, 22,
+     -1, 24, 25, 26, -1, 28, 29, 30,
+     -1, -1, -1, -1, -1, -1, -1, -1},
+    {-1, -1, -1, -1, -1, -1, -1, -1,
+     -1,  0,  1,  2, -1,  4,  5,  6,
+     -1,  8,  9, 10, -1, 12, 13, 14,
+     -1, 16, 17, 18, -1, 20, 21, 22}
 };
 
 
 /* my function prototypes ----------------------------------------------------*/
 
     /* stage 0 */
+void read_options(int argc, char *argv[], search_t*);
+void print_usage(char *program);
+void free_search(search_t*);
 void set_board(board_t);
-void print_board(board_t, int first_print);
+void print_board(output_t*, board_t, int first_print);
 node_t* make_empty_node(void);
-void fill_node(node_t *node, board_t, move_t*);
-void process_input(board_t, move_t *main_move, char *command);
-void free_tree(node_t*);
+void fill_node(node_t *node, bitboard_t*, move_t*);
+void process_input(output_t*, input_t*, board_t, move_t *main_move, 
+    char *command);
+void process_record(output_t*, record_t*, board_t, move_t *main_move, 
+    char *command);
+int play_input_move(output_t*, board_t, bitboard_t*, move_t *main_move);
 
     /* stage 1 & 2 */
-node_t* play_best_move(node_t*, board_t, move_t  *main_move);
+int play_best_move(search_t*, node_t*, board_t, move_t *main_move);
+void search_best_move(search_t*, node_t *root);
+void apply_best_move(node_t *root, board_t, move_t *main_move);
+
+    /* perft mode */
+void run_perft(search_t*, node_t *root, int depth);
+unsigned long perft(search_t*, node_t*, int depth);
+void run_bench(search_t*);
+int replay_moves(board_t, move_t *main_move, const char *moves);
+
+    /* engine mode */
+void run_engine(search_t*);
+void engine_new(engine_t*);
+void engine_moves(engine_t*);
+void engine_go(engine_t*);
+void* engine_search(void *engine);
+void engine_wait(engine_t*);
+
+    /* endgame tables */
+void build_tables(search_t*, int max_pieces, char *filename);
+uint16_t solve_position(search_t*, uint16_t *solved, bitboard_t*, 
+    int move_num, int sweep);
+
+    /* opening book */
+void build_book(search_t*, int plies, char *filename);
+void collect_book(search_t*, bitboard_t*, int move_num, int plies, 
+    book_position_t **positions, int *n_positions, int *max_positions);
+int compare_book(const void *a, const void *b);
+
+    /* tournament mode */
+void run_tournament(search_t*);
+int parse_player(search_t*, char *spec, player_t*);
+void* tournament_worker(void *worker);
+void prepare_player(tournament_t*, player_t*, search_t *player);
+void play_game(tournament_t*, search_t players[2], int game);
+void print_player(player_t*, char name);
+
+    /* batch mode */
+void run_batch(search_t*);
+game_t* read_games(char *filename, int *n_games);
+void* batch_worker(void *worker);
+void analyse_game(search_t*, game_t*);
+void print_game(game_t*, int number);
 
     /* stage 0 helper functions */
 int illegal_move(board_t, move_t*);
+void set_move_cells(board_t, move_t*);
 int misc_illegal_move(board_t, move_t*);
 void print_error(int error_num);
 void make_move(board_t, move_t*);
 void check_tower(board_t, move_t*);
-void print_move_info(board_t, move_t*, int cost, int minimax_move);
+void print_move_info(output_t*, board_t, move_t*, int cost, 
+    int minimax_move);
+void print_last(output_t*);
 int node_cost(node_t*);
-int cost(board_t);
-void check_winner(node_t*);
+int cost(bitboard_t*);
+int check_winner(output_t*, node_t*);
 
     /* stage 1 & 2 helper functions */
-void fill_tree(node_t*, int depth);
-move_t* fill_moves_arr(node_t *node, moveset_t *moveset);
-move_t* get_moves(node_t*, cell_t*, moveset_t *moveset);
-move_t* get_move(board_t, move_t*, int quadrant, moveset_t *moveset);
-move_t* realloc_moves_arr(moveset_t *moveset);
-int minimax_cost(node_t*, int best_max, int best_min);
+void iterate_search(search_t*, node_t *root);
+void aspiration_search(search_t*, node_t *root, int depth, int last_cost);
+void split_search(search_t*, node_t *root, int depth);
+void* split_worker(void *worker);
+void lazy_search(search_t*, node_t *root, int depth);
+void* lazy_helper(void *worker);
+void prepare_worker(search_t*, search_t *worker);
+void reset_counters(search_t*);
+void merge_worker(search_t*, search_t *worker);
+void print_thread_nodes(search_t*, unsigned long main_nodes);
+void measure_efficiency(search_t*, node_t *root, long parallel_ms);
+void print_json(search_t*, node_t *root, long search_ns, long output_ns);
+int search_cost(search_t*, node_t*, int depth, int ply, int best_max, 
+    int best_min);
+int quiesce(search_t*, node_t*, int plies, int best_max, int best_min);
+move_t* fill_moves_arr(node_t *node, moveset_t *moveset, arena_t*);
+int* score_moves(search_t*, node_t*, moveset_t*, uint8_t hash_move, int ply);
+int pick_move(int *scores, int n_moves);
+void update_order(search_t*, node_t*, move_t*, int depth, int ply);
+void age_order(search_t*);
+
+    /* bitboard helper functions */
+void board_to_bits(board_t, bitboard_t*);
+int valid_bits(bitboard_t*);
+char bits_cell(bitboard_t*, int square);
+int bits_type(bitboard_t*, bits_t square_bit);
+bits_t shift_quad(bits_t, int quadrant);
+int get_move_masks(bitboard_t*, int move_num, bits_t *steps, bits_t *jumps);
+void bits_make_move(bitboard_t*, move_t*, undo_t*);
+void bits_unmake_move(bitboard_t*, move_t*, undo_t*);
+int bits_check_tower(bitboard_t*, move_t*);
+int count_bits(bits_t);
+int first_bit(bits_t);
+
+    /* transposition table helper functions */
+int tt_init(tt_t*, size_t megabytes);
+uint64_t tt_hash(tt_t*, bitboard_t*, int move_num);
+uint64_t tt_update_hash(tt_t*, uint64_t hash, undo_t*);
+int tt_probe(tt_t*, uint64_t hash, tt_entry_t*);
+int tt_cutoff(tt_t*, tt_entry_t*, int depth, int best_max, int best_min);
+uint64_t tt_pack_entry(tt_entry_t*);
+void tt_unpack_entry(uint64_t data, tt_entry_t*);
+void tt_store(tt_t*, node_t*, int depth, int bound);
+uint8_t tt_pack_move(move_t*);
+int tt_unpack_move(uint8_t packed, move_t*);
+void tt_print_stats(tt_t*);
+void tt_clear(tt_t*);
+void tt_free(tt_t*);
+uint64_t split_mix(uint64_t *state);
+
+    /* endgame table helper functions */
+void tb_init(tb_t*, int max_pieces);
+int tb_load(tb_t*, char *filename);
+uint64_t tb_index(tb_t*, bitboard_t*, int move_num);
+void tb_position(tb_t*, int pieces, uint64_t index, bitboard_t*, 
+    int *move_num);
+int tb_probe(tb_t*, node_t*);
+void tb_free(tb_t*);
+
+    /* opening book helper functions */
+int book_load(book_t*, char *filename);
+int book_probe(search_t*, node_t *root);
+void book_free(book_t*);
+
+    /* arena helper functions */
+void arena_init(arena_t*);
+void* arena_alloc(arena_t*, size_t size);
+arena_mark_t arena_mark(arena_t*);
+void arena_rewind(arena_t*, arena_mark_t);
+void arena_reset(arena_t*);
+void arena_free(arena_t*);
+
+    /* input helper functions */
+void read_input(char *filename, input_t*);
+int next_line(input_t*, char **line, int *length);
+int parse_move(char *line, int length, move_t*);
+int parse_command(char *line, int length);
+int blank_line(char *line, int length);
+void free_input(input_t*);
+
+    /* game record helper functions */
+void record_init(record_t*);
+void record_move(record_t*, move_t*);
+int read_record(input_t*, record_t*);
+int write_record(record_t*, FILE*);
+void convert_input(input_t*);
+void bits_to_board(bitboard_t*, board_t);
+void free_record(record_t*);
+
+    /* position string helper functions */
+int parse_position(char *text, int length, board_t, int *move_num);
+int read_position(input_t*, board_t, int *move_num);
+void format_position(board_t, int move_num, char *text);
 
     /* miscellaneous helper functions */
-void copy_board(board_t original, board_t new);
+long now_ms(void);
+long now_ns(void);
+int on_board(int row, int col);
 int a2n(char);
 char n2a(int);
 
@@ -145,71 +738,475 @@ char n2a(int);
 int
 main(int argc, char *argv[]) {
 
+    /* read search settings */
+    search_t search;
+    read_options(argc, argv, &search);
+
+    /* analyse a file of games instead of one game from input */
+    if (search.batch_file != NULL) {
+        run_batch(&search);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* solve every position with few pieces and write the results */
+    if (search.tables_file != NULL) {
+        build_tables(&search, search.table_pieces, search.tables_file);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* search every early position deeply and write the best moves */
+    if (search.book_file != NULL) {
+        build_book(&search, search.book_plies, search.book_file);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* play complete games between two settings */
+    if (search.match_games) {
+        run_tournament(&search);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* keep answering commands until told to quit */
+    if (search.engine) {
+        run_engine(&search);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* time the move generator on the reference positions */
+    if (search.bench) {
+        run_bench(&search);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* rewrite the input as a record or a record as text, without playing */
+    input_t input;
+    read_input(search.input_file, &input);
+    if (search.convert) {
+        convert_input(&input);
+        free_input(&input);
+        free_search(&search);
+        return EXIT_SUCCESS;
+    }
+
+    /* keep the game to write it as a record at the end */
+    record_t record, in_record;
+    if (search.record_file != NULL) {
+        record_init(&record);
+        search.output.record = &record;
+    }
+
     /* Stage 0 - reading, analysing, and printing input data */
 
-    /* initialise and print starting board */
+    /* initialise and print starting board, which a record may give */
     board_t main_board = {{0}};
-    set_board(main_board);
-    print_board(main_board, 1);
-
-    /* initialise empty starting move */
     move_t main_move;
     main_move.num = 0;
+    int is_record = read_record(&input, &in_record), has_position = 1;
+    if (is_record && in_record.has_position) {
+        bits_to_board(&in_record.bits, main_board);
+        main_move.num = in_record.move_num;
+    }
+    else if ((search.position != NULL) && !parse_position(search.position, 
+        strlen(search.position), main_board, &main_move.num)) {
+        fprintf(stderr, "malformed position \"%s\"\n", search.position);
+        exit(EXIT_FAILURE);
+    }
+    else if (search.position == NULL) {
+        set_board(main_board);
+        has_position = 0;
+    }
+
+    /* a position on the first line of text input replaces the others */
+    if (!is_record && read_position(&input, main_board, &main_move.num)) {
+        has_position = 1;
+    }
+    if ((search.record_file != NULL) && has_position) {
+        record.has_position = 1;
+        board_to_bits(main_board, &record.bits);
+        record.move_num = main_move.num;
+    }
+    print_board(&search.output, main_board, 1);
 
     /* read and process input */
     char command = '\0';
-    process_input(main_board, &main_move, &command);
+    if (is_record) {
+        process_record(&search.output, &in_record, main_board, &main_move, 
+            &command);
+        free_record(&in_record);
+    }
+    else {
+        process_input(&search.output, &input, main_board, &main_move, 
+            &command);
+    }
+    free_input(&input);
     
+    /* count leaves below the input position instead of running a command */
+    if (search.perft_depth) {
+        node_t perft_root;
+        bitboard_t perft_bits;
+        board_to_bits(main_board, &perft_bits);
+        fill_node(&perft_root, &perft_bits, &main_move);
+        run_perft(&search, &perft_root, search.perft_depth);
+    }
+
     /* input command was given */
-    if (command) {
+    else if (command) {
 
-        /* make tree root and node for best move */
+        /* make search root, replaced by the best move each action */
         node_t *main_node;
+        bitboard_t main_bits;
+        board_to_bits(main_board, &main_bits);
         main_node = make_empty_node();
-        fill_node(main_node, main_board, &main_move);
+        fill_node(main_node, &main_bits, &main_move);
 
         /* Stage 1 - compute and print next action */ 
         if (command == ACTION) {
-
-            /* temporary pointer for tree */
-            node_t *temp_root;
-            temp_root = make_empty_node();
-            *temp_root = *main_node;
-
-            /* find best move and copy to main node */
-            *main_node = *play_best_move(temp_root, main_board, &main_move);
-
-            /* free temporary tree */
-            free_tree(temp_root);
-            temp_root = NULL;
+            play_best_move(&search, main_node, main_board, &main_move);
         }  
 
         /* Stage 2 - machines game */
         else if (command == PLAY) {
             int i;
             for (i = 0; i < COMP_ACTIONS; i++) {        
-
-                /* temporary pointer for tree */
-                node_t *temp_root;
-                temp_root = make_empty_node();
-                *temp_root = *main_node;
-
-                /* find best move and copy to main node */
-                *main_node = *play_best_move(temp_root, main_board, &main_move); 
-
-                /* free temporary tree */
-                free_tree(temp_root);  
-                temp_root = NULL;          
+                if (play_best_move(&search, main_node, main_board, 
+                    &main_move)) {
+                    break;
+                }
             }
         }
         free(main_node);
         main_node = NULL;
     }
+    print_last(&search.output);
+    if (search.print_final) {
+        char position[POSITION_TEXT];
+        format_position(main_board, main_move.num, position);
+        printf("POSITION: %s\n", position);
+    }
+
+    /* write the game played as a record, its command already carried out */
+    if (search.record_file != NULL) {
+        FILE *fp = fopen(search.record_file, "wb");
+        if (fp == NULL) {
+            fprintf(stderr, "cannot open record file %s\n", 
+                search.record_file);
+            exit(EXIT_FAILURE);
+        }
+        if (!write_record(&record, fp)) {
+            fprintf(stderr, "cannot write record file %s\n", 
+                search.record_file);
+            exit(EXIT_FAILURE);
+        }
+        fclose(fp);
+        free_record(&record);
+    }
+    free_search(&search);
     return EXIT_SUCCESS;
 }
 
 /* STAGE 0 -------------------------------------------------------------------*/
 
+/* reads command line options into the search settings
+*/
+void
+read_options(int argc, char *argv[], search_t *search) {
+    arena_init(&search->arena);
+    search->depth = TREE_DEPTH;
+    search->report_memory = 0;
+    search->report_stats = 0;
+    search->time_budget = 0;
+    search->order_moves = 1;
+    search->n_threads = 1;
+    search->lazy_smp = search->measure_efficiency = 0;
+    search->workers = NULL;
+    search->halt = search->stop = NULL;
+    search->root_bound = NULL;
+    search->engine = 0;
+    search->batch_file = NULL;
+    search->perft_depth = search->bench = 0;
+    search->json = NULL;
+    search->output.mode = OUTPUT_FULL;
+    search->output.last[0] = '\0';
+    search->input_file = NULL;
+    search->position = NULL;
+    search->print_final = 0;
+    search->record_file = NULL;
+    search->convert = 0;
+    search->output.record = NULL;
+    search->tables_file = NULL;
+    search->table_pieces = 0;
+    tb_init(&search->tb, 0);
+    search->book.map = NULL;
+    search->book.n_entries = 0;
+    search->book_file = NULL;
+    search->book_plies = 0;
+    search->book_move = 0;
+    search->match_games = 0;
+    search->quiesce_plies = 0;
+    search->pvs = 1;
+    memset(search->killers, TT_NO_MOVE, sizeof(search->killers));
+    memset(search->history, 0, sizeof(search->history));
+    int hash_mb = TT_DEFAULT_MB, depth = 0, threads_given = 0;
+
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], OPT_MEMORY) == 0) {
+            search->report_memory = 1;
+        }
+        else if (strcmp(argv[i], OPT_STATS) == 0) {
+            search->report_stats = 1;
+        }
+        else if (strcmp(argv[i], OPT_NO_ORDER) == 0) {
+            search->order_moves = 0;
+        }
+        else if (strcmp(argv[i], OPT_LAZY) == 0) {
+            search->lazy_smp = 1;
+        }
+        else if (strcmp(argv[i], OPT_EFFICIENCY) == 0) {
+            search->measure_efficiency = 1;
+        }
+        else if ((strcmp(argv[i], OPT_HASH) == 0) && (i + 1 < argc)) {
+            hash_mb = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], OPT_DEPTH) == 0) && (i + 1 < argc)) {
+            depth = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], OPT_TIME) == 0) && (i + 1 < argc)) {
+            search->time_budget = atol(argv[++i]);
+        }
+        else if ((strcmp(argv[i], OPT_THREADS) == 0) && (i + 1 < argc)) {
+            search->n_threads = atoi(argv[++i]);
+            threads_given = 1;
+        }
+        else if (strcmp(argv[i], OPT_BENCH) == 0) {
+            search->bench = 1;
+        }
+        else if ((strcmp(argv[i], OPT_PERFT) == 0) && (i + 1 < argc)) {
+            search->perft_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], OPT_COMPACT) == 0) {
+            search->output.mode = OUTPUT_COMPACT;
+        }
+        else if (strcmp(argv[i], OPT_SILENT) == 0) {
+            search->output.mode = OUTPUT_SILENT;
+        }
+        else if ((strcmp(argv[i], OPT_POSITION) == 0) && (i + 1 < argc)) {
+            search->position = argv[++i];
+        }
+        else if (strcmp(argv[i], OPT_FINAL) == 0) {
+            search->print_final = 1;
+        }
+        else if (strcmp(argv[i], OPT_ENGINE) == 0) {
+            search->engine = 1;
+        }
+        else if (strcmp(argv[i], OPT_CONVERT) == 0) {
+            search->convert = 1;
+        }
+        else if ((strcmp(argv[i], OPT_WRITE) == 0) && (i + 1 < argc)) {
+            search->record_file = argv[++i];
+        }
+        else if ((strcmp(argv[i], OPT_INPUT) == 0) && (i + 1 < argc)) {
+            search->input_file = argv[++i];
+        }
+        else if ((strcmp(argv[i], OPT_JSON) == 0) && (i + 1 < argc)) {
+            search->json = fopen(argv[++i], "w");
+            if (search->json == NULL) {
+                fprintf(stderr, "cannot open statistics file %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if ((strcmp(argv[i], OPT_TABLES) == 0) && (i + 1 < argc)) {
+            if (!tb_load(&search->tb, argv[++i])) {
+                fprintf(stderr, "cannot load endgame tables %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if ((strcmp(argv[i], OPT_BUILD_TABLES) == 0) && (i + 2 < argc)) {
+            search->table_pieces = atoi(argv[++i]);
+            search->tables_file = argv[++i];
+        }
+        else if ((strcmp(argv[i], OPT_BOOK) == 0) && (i + 1 < argc)) {
+            if (!book_load(&search->book, argv[++i])) {
+                fprintf(stderr, "cannot load opening book %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if ((strcmp(argv[i], OPT_BUILD_BOOK) == 0) && (i + 2 < argc)) {
+            search->book_plies = atoi(argv[++i]);
+            search->book_file = argv[++i];
+        }
+        else if (strcmp(argv[i], OPT_FULL_WINDOW) == 0) {
+            search->pvs = 0;
+        }
+        else if ((strcmp(argv[i], OPT_QUIESCE) == 0) && (i + 1 < argc)) {
+            search->quiesce_plies = atoi(argv[++i]);
+            if (search->quiesce_plies <= 0) {
+                search->quiesce_plies = MAX_CAPTURES;
+            }
+        }
+        else if ((strcmp(argv[i], OPT_MATCH) == 0) && (i + 3 < argc)) {
+            search->match_games = atoi(argv[++i]);
+            search->match_specs[0] = argv[++i];
+            search->match_specs[1] = argv[++i];
+            if (search->match_games < 1) {
+                print_usage(argv[0]);
+            }
+        }
+        else if ((strcmp(argv[i], OPT_BATCH) == 0) && (i + 1 < argc)) {
+            search->batch_file = argv[++i];
+        }
+        else {
+            print_usage(argv[0]);
+        }
+    }
+    if ((depth < 0) || (depth > MAX_DEPTH) || (search->time_budget < 0) ||
+        (search->perft_depth < 0) || ((search->tables_file != NULL) && 
+        ((search->table_pieces < 1) || 
+        (search->table_pieces > TB_MAX_PIECES))) ||
+        ((search->book_file != NULL) && (search->book_plies < 1)) ||
+        (search->n_threads < 1) || (search->n_threads > MAX_THREADS) ||
+        (hash_mb < 0) || ((size_t)hash_mb > SIZE_MAX / MEGABYTE)) {
+        print_usage(argv[0]);
+    }
+    if (!tt_init(&search->tt, hash_mb)) {
+        fprintf(stderr, "cannot allocate a %d MB hash table\n", hash_mb);
+        print_usage(argv[0]);
+    }
+
+    /* a tournament plays a game on every core unless -j is given */
+    if (search->match_games && !threads_given) {
+        search->n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        search->n_threads = (search->n_threads < 1) ? 1 : 
+            (search->n_threads > MAX_THREADS) ? MAX_THREADS : 
+            search->n_threads;
+    }
+
+    /* each extra thread keeps its own arena and ordering tables */
+    if (search->n_threads > 1) {
+        search->workers = calloc(search->n_threads, sizeof(search_t));
+        assert(search->workers != NULL);
+        for (i = 0; i < search->n_threads; i++) {
+            arena_init(&search->workers[i].arena);
+        }
+    }
+
+    /* a time budget deepens as far as time allows, so its moves already
+       depend on timing and deeper stored results can be used */
+    if (search->time_budget) {
+        search->depth = MAX_DEPTH;
+        search->tt.exact_depth = 0;
+    }
+
+    /* lazy SMP helpers search deeper to fill the table for the main thread,
+       so their results must be usable, making moves depend on timing */
+    if (search->lazy_smp) {
+        search->tt.exact_depth = 0;
+    }
+    if (depth) {
+        search->depth = depth;
+    }
+
+    /* a book is only worth building from searches deeper than play's */
+    else if (search->book_file != NULL) {
+        search->depth = BOOK_DEPTH;
+    }
+}
+
+/* returns memory held by the search settings back to the heap
+*/
+void
+free_search(search_t *search) {
+    int i;
+    if (search->workers != NULL) {
+        for (i = 0; i < search->n_threads; i++) {
+            arena_free(&search->workers[i].arena);
+        }
+        free(search->workers);
+        search->workers = NULL;
+    }
+    arena_free(&search->arena);
+    tt_free(&search->tt);
+    tb_free(&search->tb);
+    book_free(&search->book);
+    if (search->json != NULL) {
+        fclose(search->json);
+        search->json = NULL;
+    }
+}
+
+/* prints the command line options and exits
+*/
+void
+print_usage(char *program) {
+    fprintf(stderr, "usage: %s [options] < moves\n", program);
+    fprintf(stderr, "  %s            report arena high-water mark\n", 
+        OPT_MEMORY);
+    fprintf(stderr, "  %s            report search statistics\n", OPT_STATS);
+    fprintf(stderr, "  %s megabytes  hash table size, 0 disables it\n", 
+        OPT_HASH);
+    fprintf(stderr, "  %s depth      search depth (default %d)\n", OPT_DEPTH,
+        TREE_DEPTH);
+    fprintf(stderr, "  %s ms         time per move, deepening until spent\n", 
+        OPT_TIME);
+    fprintf(stderr, "  %s            search moves in generated order\n", 
+        OPT_NO_ORDER);
+    fprintf(stderr, "  %s            search every move with the full window, "
+        "not PVS and\n                aspiration windows\n", OPT_FULL_WINDOW);
+    fprintf(stderr, "  %s plies      play out up to plies captures at leaves, "
+        "0 for all\n", OPT_QUIESCE);
+    fprintf(stderr, "  %s threads    split root moves across threads\n", 
+        OPT_THREADS);
+    fprintf(stderr, "  %s            threads search the whole tree, sharing "
+        "the hash table\n", OPT_LAZY);
+    fprintf(stderr, "  %s            measure speedup over one thread\n", 
+        OPT_EFFICIENCY);
+    fprintf(stderr, "  %s file       analyse every game in a file, one game "
+        "per thread\n", OPT_BATCH);
+    fprintf(stderr, "  %s games a b  play complete games between settings a "
+        "and b, each\n                a mix of d<depth>, t<ms>, q<plies>, "
+        "n (unordered),\n                %c (%s tables), %c (%s book)\n", 
+        OPT_MATCH, 'T', OPT_TABLES, 'k', OPT_BOOK);
+    fprintf(stderr, "  %s depth      count leaves below the input position\n",
+        OPT_PERFT);
+    fprintf(stderr, "  %s            run the move generator benchmark\n", 
+        OPT_BENCH);
+    fprintf(stderr, "  %s file       write statistics of each move as JSON "
+        "lines\n", OPT_JSON);
+    fprintf(stderr, "  %s            print one line per move, without boards\n",
+        OPT_COMPACT);
+    fprintf(stderr, "  %s            print only the last move and the result\n",
+        OPT_SILENT);
+    fprintf(stderr, "  %s file       read moves from a file instead of stdin\n",
+        OPT_INPUT);
+    fprintf(stderr, "  %s file       write the game as a binary record\n", 
+        OPT_WRITE);
+    fprintf(stderr, "  %s            convert text moves to a record on stdout, "
+        "or a record to text\n", OPT_CONVERT);
+    fprintf(stderr, "  %s position   start from a position, such as\n"
+        "                wwww/wwww/wwww/..../..../bbbb/bbbb/bbbb %c 1\n", 
+        OPT_POSITION, SIDE_BLACK);
+    fprintf(stderr, "  %s            print the final position\n", OPT_FINAL);
+    fprintf(stderr, "  %s            answer %s, %s, %s, %s [%s n] [%s ms], %s, "
+        "%s and %s commands\n", OPT_ENGINE, CMD_NEW, CMD_POSITION, CMD_MOVES, 
+        CMD_GO, GO_DEPTH, GO_TIME, CMD_STOP, CMD_BOARD, CMD_QUIT);
+    fprintf(stderr, "  %s pieces file  solve positions with up to %d pieces "
+        "into endgame tables\n", OPT_BUILD_TABLES, TB_MAX_PIECES);
+    fprintf(stderr, "  %s file       look up positions in endgame tables\n", 
+        OPT_TABLES);
+    fprintf(stderr, "  %s plies file build an opening book of the first plies, "
+        "searched to depth %d unless %s is given\n", OPT_BUILD_BOOK, 
+        BOOK_DEPTH, OPT_DEPTH);
+    fprintf(stderr, "  %s file       play book moves without searching\n", 
+        OPT_BOOK);
+    exit(EXIT_FAILURE);
+}
+
 /* sets board to starting position 
 */
 void
@@ -265,22 +1262,28 @@ set_board(board_t board) {
     }
 }
 
-/* prints board in a nicer format
+/* prints board in a nicer format, rendered first so it is written at once
 */
 void
-print_board(board_t board, int first_print) {
+print_board(output_t *output, board_t board, int first_print) {
+    char text[BOARD_TEXT], *end = text;
     int i, j;
+    if (output->mode != OUTPUT_FULL) {
+        return;
+    }
     
     /* initial board info */ 
     if (first_print) {
-        printf("BOARD SIZE: %dx%d\n", ROWS, COLS);
-        printf("#BLACK PIECES: %d\n", INITIAL_TEAM_PIECES);
-        printf("#WHITE PIECES: %d\n", INITIAL_TEAM_PIECES);
+        end += sprintf(end, "BOARD SIZE: %dx%d\n", ROWS, COLS);
+        bitboard_t bits;
+        board_to_bits(board, &bits);
+        end += sprintf(end, "#BLACK PIECES: %d\n", count_bits(bits.black));
+        end += sprintf(end, "#WHITE PIECES: %d\n", count_bits(bits.white));
     }
    
     /* column header */
-    printf("     A   B   C   D   E   F   G   H\n");
-    printf("   +---+---+---+---+---+---+---+---+\n");
+    end += sprintf(end, "     A   B   C   D   E   F   G   H\n");
+    end += sprintf(end, ROW_SEPARATOR);
 
     /* board rows */
     int row, col;
@@ -288,735 +1291,3746 @@ print_board(board_t board, int first_print) {
         row = i;
 
         /* row number */
-        printf(" %d |", row + 1);
+        end += sprintf(end, " %d |", row + 1);
 
         /* row elements */
         for (j = 0; j < COLS; j++) {
             col = j;
-            printf(" %c |", board[row][col]);
+            *end++ = ' ';
+            *end++ = board[row][col];
+            *end++ = ' ';
+            *end++ = '|';
         }
-        printf("\n   +---+---+---+---+---+---+---+---+\n");
+        *end++ = '\n';
+        memcpy(end, ROW_SEPARATOR, sizeof(ROW_SEPARATOR) - 1);
+        end += sizeof(ROW_SEPARATOR) - 1;
     }
+    fwrite(text, 1, end - text, stdout);
 }
 
-/* makes an empty minimax tree and passes its pointer 
+/* makes an empty search node and passes its pointer 
 */
 node_t*
 make_empty_node() {
     node_t *node;
     node = malloc(sizeof(*node));
     assert(node != NULL);
-    node->children = NULL;
     return node;
 }
 
-/* assigns node variables needed to fill a tree
+/* assigns node variables needed to search from it
 */
 void
-fill_node(node_t *node, board_t parent_board, move_t *cur_move) {
-    copy_board(parent_board, node->board);
+fill_node(node_t *node, bitboard_t *parent_bits, move_t *cur_move) {
+    node->bits = parent_bits;
     node->move = *cur_move;
     node->max_depth = 0;
 }
 
-/* reads and applies input moves
+/* reads and applies input moves, exiting at an illegal or malformed one
 */
 void
-process_input(board_t main_board, move_t *main_move, char *command) {
-    int num1, num2, error;
-    char char1, char2;
+process_input(output_t *output, input_t *input, board_t main_board, 
+    move_t *main_move, char *command) {
+    int length;
+    char *line;
+
+    /* board kept as bits alongside, so game end can be checked */
+    bitboard_t bits;
+    board_to_bits(main_board, &bits);
 
     /* get moves from user */
-    while (scanf("%c%d-%c%d\n", &char1, &num1, &char2, &num2) == 4) {  
+    while (next_line(input, &line, &length)) {
+        if (!parse_move(line, length, main_move)) {
 
-        /* put game info into node */
-        node_t *node;
-        node = make_empty_node(); 
-        fill_node(node, main_board, main_move);
-        node->max_depth = 1; // ensure cost accounts for game end
-        
-        /* assign move coordinates */
-        node->move.src.row = num1 - 1;
-        node->move.tgt.row = num2 - 1;   
-        node->move.src.col = a2n(char1);
-        node->move.tgt.col = a2n(char2);
-        node->move.num = node->move.num;
-
-        /* assign move and board */
-        node->move.src.cell = node->board[num1 - 1][a2n(char1)];
-        node->move.tgt.cell = node->board[num2 - 1][a2n(char2)];
-        *main_move = node->move; 
-        
-        /* check if move is valid */
-        error = illegal_move(node->board, &node->move);
-        if (error) {
-            print_error(error);
-            free(node);
-            node = NULL;
+            /* command at end of input */
+            if (parse_command(line, length)) {
+                *command = parse_command(line, length);
+                return;
+            }
+            if (blank_line(line, length)) {
+                continue;
+            }
+            print_last(output);
+            fflush(stdout);
+            fprintf(stderr, "line %d: malformed move \"%.*s\"\n", 
+                input->line_num, length, line);
             exit(EXIT_FAILURE);
         }
 
-        /* apply move to node so game end can be checked */
-        make_move(node->board, &node->move);
-
-        /* apply move to main board */ 
-        make_move(main_board, main_move);
-        print_move_info(main_board, main_move, node_cost(node), 0);
-        print_board(node->board, 0); 
-        check_winner(node);
-        free(node);
-    }
-
-    /* check for command at end of input */
-    if ((char1 == ACTION) || (char1 == PLAY)) {
-        *command = char1;
+        /* game is over, so no command is run */
+        if (play_input_move(output, main_board, &bits, main_move)) {
+            return;
+        }
     }
 }
 
-/* returns allocated memory back to the heap 
+/* applies the moves of a binary record, then takes its command
 */
 void
-free_tree(node_t *node) {
+process_record(output_t *output, record_t *record, board_t main_board, 
+    move_t *main_move, char *command) {
+    bitboard_t bits;
+    int i;
+    board_to_bits(main_board, &bits);
+    for (i = 0; i < record->n_moves; i++) {
+        if (!tt_unpack_move(record->moves[i], main_move)) {
+            print_last(output);
+            print_error(1);
+            exit(EXIT_FAILURE);
+        }
+        if (play_input_move(output, main_board, &bits, main_move)) {
+            return;
+        }
+    }
+    *command = record->command;
+}
 
-    /* free leaf nodes */
-    if (node->num_children == 0) {
-        free(node); 
-        node = NULL;    
-        return;
+/* checks and applies one input move, printing it and returning 1 if it won
+   the game, exiting if it is illegal
+*/
+int
+play_input_move(output_t *output, board_t main_board, bitboard_t *bits,
+    move_t *main_move) {
+    int error;
+    node_t node;
+    move_t bits_move;
+    undo_t undo;
+    set_move_cells(main_board, main_move);
+        
+    /* check if move is valid */
+    error = illegal_move(main_board, main_move);
+    if (error) {
+        print_last(output);
+        print_error(error);
+        exit(EXIT_FAILURE);
     }
 
-    int i;
-    for (i = 0; i < node->num_children; i++) {
-        free_tree(node->children[i]);
+    /* apply move to main board and its bits */ 
+    if (output->record != NULL) {
+        record_move(output->record, main_move);
     }
-    node->num_children = 0;
-}
+    bits_move = *main_move;
+    bits_make_move(bits, &bits_move, &undo);
+    make_move(main_board, main_move);
+    fill_node(&node, bits, main_move);
+    node.max_depth = 1; // ensure cost accounts for game end
 
+    print_move_info(output, main_board, main_move, node_cost(&node), 0);
+    print_board(output, main_board, 0); 
+    return check_winner(output, &node);
+}
 
 /* STAGE 1 & 2-----------------------------------------------------------------*/
 
-/* plays move determined by minimax algorithm
+/* plays move determined by minimax algorithm, returning 1 if it won the game
 */
-node_t*
-play_best_move(node_t *root, board_t main_board, move_t *main_move) {
+int
+play_best_move(search_t *search, node_t *root, board_t main_board, 
+    move_t *main_move) {
+    long search_ns = now_ns(), output_ns;
+    search_best_move(search, root);
+    search_ns = now_ns() - search_ns;
+    if (search->output.record != NULL) {
+        record_move(search->output.record, &root->best_move);
+    }
+    apply_best_move(root, main_board, main_move);
+    output_ns = now_ns();
+    print_move_info(&search->output, main_board, main_move, root->cost, 1);
+    print_board(&search->output, main_board, 0);
+    output_ns = now_ns() - output_ns;
+    if (search->json != NULL) {
+        print_json(search, root, search_ns, output_ns);
+    }
+    return check_winner(&search->output, root);
+}
 
-    /* determine best move using minimax */
-    fill_tree(root, TREE_DEPTH);
-    root->propagated_cost = minimax_cost(root, INT_MIN, INT_MAX);
+/* determines the best move from the root using minimax
+*/
+void
+search_best_move(search_t *search, node_t *root) {
+    search->arena.high_water = search->arena.allocs = 0;
+    search->tt.age++;
+    memset(&search->tt.stats, 0, sizeof(search->tt.stats));
+    root->hash = tt_hash(&search->tt, root->bits, root->move.num);
+
+    /* a book position is answered without searching */
+    search->book_move = book_probe(search, root);
+    if (search->book_move) {
+        return;
+    }
+    int measure = search->measure_efficiency && (search->n_threads > 1);
+    if (measure) {
+        tt_clear(&search->tt);
+    }
+    long start_ms = now_ms();
+    iterate_search(search, root);
+    if (measure) {
+        measure_efficiency(search, root, now_ms() - start_ms);
+    }
 
-    /* reassign root to child with best move */
-    root = root->children[root->best_child];
+    /* release every node and move list of the search at once */
+    arena_reset(&search->arena);
+    if (search->report_memory) {
+        fprintf(stderr, "ARENA HIGH-WATER MARK: %lu BYTES\n", 
+            (unsigned long)search->arena.high_water);
+    }
+    if (search->report_stats) {
+        tt_print_stats(&search->tt);
+    }
+}
 
-    /* reset move number (make_move iterates it) */
-    *main_move = root->move;
-    main_move->num--;
+/* makes the root's best move on the main board and advances the root to it
+*/
+void
+apply_best_move(node_t *root, board_t main_board, move_t *main_move) {
 
     /* apply move to main board */ 
+    *main_move = root->best_move;
     make_move(main_board, main_move);
-    print_move_info(main_board, main_move, node_cost(root), 1);
-    print_board(main_board, 0);
-    check_winner(root);
 
-    /* return pointer to best node */
-    return root;
+    /* advance root to the child with best move */
+    undo_t undo;
+    fill_node(root, root->bits, &root->best_move);
+    bits_make_move(root->bits, &root->move, &undo);
+    root->max_depth = 1; // ensure cost accounts for game end
+    node_cost(root);
 }
 
-/* stage 0 helper functions ------------------------------------------------- */
+/* PERFT MODE ----------------------------------------------------------------*/
 
-/* checks if move is illegal or not
+/* counts the leaves below each root move to a depth, then their total and the
+   rate they were generated at
 */
-int
-illegal_move(board_t board, move_t *move) {    
-    int row1, row2, col1, col2, next_move_num, error;
-    char src_cell = move->src.cell;
-    char tgt_cell = move->tgt.cell;
-    row1 = move->src.row;
-    row2 = move->tgt.row;
-    col1 = move->src.col;
-    col2 = move->tgt.col;
-    next_move_num = move->num + 1;
-
-    /* ERROR #1: source cell is outside of the board */
-    if ((row1 < 0) || (row1 > ROWS - 1) || (col1 < 0) || (col1 > COLS - 1)) {
-        return error = 1;
+void
+run_perft(search_t *search, node_t *root, int depth) {
+    int i;
+    unsigned long leaves, total = 0;
+    long elapsed = now_ms();
+    moveset_t moveset;
+    node_t child;
+    undo_t undo;
+    fill_moves_arr(root, &moveset, &search->arena);
+    for (i = 0; i < moveset.n_moves; i++) {
+        fill_node(&child, root->bits, &moveset.moves_arr[i]);
+        bits_make_move(root->bits, &child.move, &undo);
+        leaves = perft(search, &child, depth - 1);
+        bits_unmake_move(root->bits, &child.move, &undo);
+        printf("%c%d-%c%d: %lu\n", n2a(child.move.src.col), 
+            child.move.src.row + 1, n2a(child.move.tgt.col), 
+            child.move.tgt.row + 1, leaves);
+        total += leaves;
     }
+    arena_reset(&search->arena);
+    elapsed = now_ms() - elapsed;
+    printf("PERFT DEPTH: %d NODES: %lu TIME: %ldms NPS: %.0f\n", depth, 
+        total, elapsed, 1000.0 * total / (elapsed ? elapsed : 1));
+}
 
-    /* ERROR #2: target cell is outside of the board */
-    if ((row2 < 0) || (row2 > ROWS - 1) || (col2 < 0) || (col2 > COLS - 1)) {
-        return error = 2;
+/* counts the positions reached after exactly depth moves, a position without
+   moves ending its line early
+*/
+unsigned long
+perft(search_t *search, node_t *node, int depth) {
+    if (depth == 0) {
+        return 1;
     }
 
-    /* ERROR #3: source cell is empty */
-    if (src_cell == CELL_EMPTY) {
-        return error = 3;
+    /* last move only needs counting, not making */
+    bits_t steps[QUADS], jumps[QUADS];
+    if (depth == 1) {
+        return get_move_masks(node->bits, node->move.num, steps, jumps);
     }
-
-    /* ERROR #4: target cell is not empty */
-    if (tgt_cell != CELL_EMPTY) {
-        return error = 4;
+    int i;
+    unsigned long leaves = 0;
+    arena_mark_t mark = arena_mark(&search->arena);
+    moveset_t moveset;
+    node_t child;
+    undo_t undo;
+    fill_moves_arr(node, &moveset, &search->arena);
+    for (i = 0; i < moveset.n_moves; i++) {
+        fill_node(&child, node->bits, &moveset.moves_arr[i]);
+        bits_make_move(node->bits, &child.move, &undo);
+        leaves += perft(search, &child, depth - 1);
+        bits_unmake_move(node->bits, &child.move, &undo);
     }
+    arena_rewind(&search->arena, mark);
+    return leaves;
+}
 
-    /* ERROR #5: source cell holds opponent's piece/tower */
-    
-    /* white turn, moving black piece */
-    if (next_move_num % 2 == 0) {
-        if ((src_cell == CELL_BPIECE) || (src_cell == CELL_BTOWER)) {
-            return error = 5;
+/* counts leaves for each reference position, checking them against their
+   known counts, and reports the overall rate; exits if any count is wrong
+*/
+void
+run_bench(search_t *search) {
+    int i, wrong = 0;
+    unsigned long leaves, total = 0;
+    long elapsed, total_ms = 0;
+    board_t board;
+    bitboard_t bits;
+    move_t move;
+    node_t root;
+    for (i = 0; i < BENCH_POSITIONS; i++) {
+        set_board(board);
+        move.num = 0;
+        if (!replay_moves(board, &move, bench_positions[i].moves)) {
+            fprintf(stderr, "bench position %d is illegal\n", i + 1);
+            exit(EXIT_FAILURE);
         }
+        board_to_bits(board, &bits);
+        fill_node(&root, &bits, &move);
+        elapsed = now_ms();
+        leaves = perft(search, &root, bench_positions[i].depth);
+        elapsed = now_ms() - elapsed;
+        total += leaves;
+        total_ms += elapsed;
+        printf("BENCH %d: DEPTH: %d NODES: %lu TIME: %ldms NPS: %.0f%s\n", 
+            i + 1, bench_positions[i].depth, leaves, elapsed, 
+            1000.0 * leaves / (elapsed ? elapsed : 1), 
+            (leaves == bench_positions[i].leaves) ? "" : " WRONG");
+        wrong |= (leaves != bench_positions[i].leaves);
     }
-
-    /* black turn, moving white piece */
-    else {
-        if ((src_cell == CELL_WPIECE) || (src_cell == CELL_WTOWER)) {
-            return error = 5;
-        }
+    arena_reset(&search->arena);
+    printf("BENCH TOTAL: NODES: %lu TIME: %ldms NPS: %.0f\n", total, total_ms,
+        1000.0 * total / (total_ms ? total_ms : 1));
+    if (wrong) {
+        exit(EXIT_FAILURE);
     }
+}
 
-    /* ERROR #6: illegal action */
-    int misc_illegal = misc_illegal_move(board, move);
-    if (misc_illegal) {
-        return error = 6;
+/* applies a space separated list of moves, returning 0 if one is illegal
+*/
+int
+replay_moves(board_t board, move_t *main_move, const char *moves) {
+    int num1, num2, length;
+    char char1, char2;
+    while (sscanf(moves, " %c%d-%c%d%n", &char1, &num1, &char2, &num2, 
+        &length) == 4) {
+        moves += length;
+        main_move->src.row = num1 - 1;
+        main_move->tgt.row = num2 - 1;   
+        main_move->src.col = a2n(char1);
+        main_move->tgt.col = a2n(char2);
+        set_move_cells(board, main_move);
+        if (illegal_move(board, main_move)) {
+            return 0;
+        }
+        make_move(board, main_move);
     }
-    return error = 0;
+    return 1;
 }
 
-/* checks other conditions for legal move
+/* ENDGAME TABLES ------------------------------------------------------------*/
+
+/* solves every position with up to max_pieces pieces by sweeping over those
+   not yet solved, smallest piece count first, and writes a byte for each:
+   TB_DRAW, the moves to a win, or TB_LOSS plus the moves to a loss
 */
-int
-misc_illegal_move(board_t board, move_t *move) {
-    int row1, row2, col1, col2, row_jump, col_jump, illegal_move;
-    row1 = move->src.row;
-    row2 = move->tgt.row;
-    col1 = move->src.col;
-    col2 = move->tgt.col;
-    row_jump = row2 - row1;
-    col_jump = col2 - col1;
-    char src_cell = board[row1][col1];
+void
+build_tables(search_t *search, int max_pieces, char *filename) {
+    tb_t *tb = &search->tb;
+    tb_init(tb, max_pieces);
+    uint64_t i, first, n, n_left, kept, counts[3];
+    uint16_t *solved, value;
+    uint32_t *left;
+    bitboard_t bits;
+    int pieces, sweep, move_num, last_sweep, longest = 0;
+    long elapsed = now_ms();
+    solved = calloc(tb->offsets[max_pieces + 1], sizeof(*solved));
+    assert(solved != NULL);
+    for (pieces = 1; pieces <= max_pieces; pieces++) {
+        first = tb->offsets[pieces];
+        n = tb->offsets[pieces + 1] - first;
+        left = malloc(n * sizeof(*left));
+        assert(left != NULL);
+        for (i = 0; i < n; i++) {
+            left[i] = i;
+        }
 
-    /* piece is not moving diagonally (1:1) */
-    if (abs(row_jump) != abs(col_jump)) {
-        return illegal_move = 1;
+        /* a position is solved by the first sweep that can, which is its
+           distance; captures reach smaller tables, so sweeps go on while
+           they may still pass on a result */
+        last_sweep = 0;
+        n_left = n;
+        for (sweep = 0; n_left > 0; sweep++) {
+            kept = 0;
+            for (i = 0; i < n_left; i++) {
+                tb_position(tb, pieces, left[i], &bits, &move_num);
+                value = solve_position(search, solved, &bits, move_num, 
+                    sweep);
+                if (value) {
+                    solved[first + left[i]] = value;
+                }
+                else {
+                    left[kept++] = left[i];
+                }
+            }
+            if (kept < n_left) {
+                last_sweep = sweep;
+            }
+            else if (sweep > longest) {
+                break;
+            }
+            n_left = kept;
+        }
+        free(left);
+        if (last_sweep > longest) {
+            longest = last_sweep;
+        }
+
+        /* positions never solved are draws */
+        memset(counts, 0, sizeof(counts));
+        for (i = first; i < first + n; i++) {
+            counts[solved[i] ? 2 - (solved[i] & 1) : 0]++;
+        }
+        printf("PIECES: %d POSITIONS: %lu WINS: %lu LOSSES: %lu DRAWS: %lu "
+            "LONGEST: %d\n", pieces, (unsigned long)n, 
+            (unsigned long)counts[1], (unsigned long)counts[2], 
+            (unsigned long)counts[0], last_sweep);
     }
-    
-    /* piece is moving in wrong direction  */
-    if ((src_cell == CELL_WPIECE) && (row_jump <= 0)) {
-        return illegal_move = 1;    
+
+    /* one byte per position after the header */
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open endgame table file %s\n", filename);
+        exit(EXIT_FAILURE);
     }
-    else if ((src_cell == CELL_BPIECE) && (row_jump >= 0)) {
-        return illegal_move = 1;
+    uint8_t header[TB_HEADER], *results;
+    memcpy(header, TB_MAGIC, TB_MAGIC_LEN);
+    for (i = 0; i < 4; i++) {
+        header[TB_MAGIC_LEN + i] = (uint32_t)max_pieces >> (8 * i);
+    }
+    n = tb->offsets[max_pieces + 1];
+    results = malloc(n);
+    assert(results != NULL);
+    for (i = 0; i < n; i++) {
+        value = solved[i] ? TB_MOVES(solved[i]) : 0;
+        if (value > TB_MAX_MOVES) {
+            value = TB_MAX_MOVES;
+        }
+        results[i] = !solved[i] ? TB_DRAW : (solved[i] & 1) ? value : 
+            TB_LOSS + value;
     }
+    fwrite(header, 1, TB_HEADER, fp);
+    fwrite(results, 1, n, fp);
+    fclose(fp);
+    free(results);
+    free(solved);
+    printf("TABLES: %s POSITIONS: %lu TIME: %ldms\n", filename, 
+        (unsigned long)n, now_ms() - elapsed);
+}
 
-    /* piece has jumped too far */
-    if (row_jump > CAPTURE_JUMP) {
-        return illegal_move = 1;    
+/* solves a position from its moves' results found by earlier sweeps: won if
+   a move reaches a lost position, lost if every move reaches a won one, and
+   returns 0 if it cannot be solved yet
+*/
+uint16_t
+solve_position(search_t *search, uint16_t *solved, bitboard_t *bits, 
+    int move_num, int sweep) {
+    arena_mark_t mark = arena_mark(&search->arena);
+    moveset_t moveset;
+    node_t node;
+    move_t move;
+    undo_t undo;
+    uint16_t value, result = 0;
+    int i, all_won = 1;
+    move.num = move_num;
+    fill_node(&node, bits, &move);
+    fill_moves_arr(&node, &moveset, &search->arena);
+    for (i = 0; (i < moveset.n_moves) && !result; i++) {
+        move = moveset.moves_arr[i];
+        bits_make_move(bits, &move, &undo);
+        value = solved[tb_index(&search->tb, bits, move.num)];
+        bits_unmake_move(bits, &move, &undo);
+        if (!value || (TB_MOVES(value) >= sweep)) {
+            all_won = 0;
+        }
+        else if (!(value & 1)) {
+            result = TB_WIN_AT(sweep);
+        }
     }
-    
-    /* a capture is being attempted */
-    if (abs(row_jump) == CAPTURE_JUMP) {
-        char cpt_cell = board[(row1 + row2) / 2][(col1 + col2) / 2];
+    arena_rewind(&search->arena, mark);
+    if (!result && all_won) {
+        result = TB_LOSS_AT(sweep);
+    }
+    return result;
+}
 
-        /* black must capture white */
-        if ((src_cell == CELL_BPIECE) || (src_cell == CELL_BTOWER)) {
-            if ((cpt_cell != CELL_WPIECE) && (cpt_cell != CELL_WTOWER)) {
-                return illegal_move = 1;
+/* OPENING BOOK --------------------------------------------------------------*/
+
+/* searches every position within plies moves of the starting board and
+   writes each one's best move, sorted by position key so it can be found by
+   binary search
+*/
+void
+build_book(search_t *search, int plies, char *filename) {
+    board_t board;
+    bitboard_t bits;
+    book_position_t *positions;
+    int n_positions = 0, max_positions = 1, i, j, n_entries = 0;
+    long elapsed = now_ms();
+    positions = malloc(max_positions * sizeof(*positions));
+    assert(positions != NULL);
+    set_board(board);
+    board_to_bits(board, &bits);
+    collect_book(search, &bits, 0, plies, &positions, &n_positions, 
+        &max_positions);
+
+    /* positions reached in several orders are only searched once */
+    qsort(positions, n_positions, sizeof(*positions), compare_book);
+    for (i = j = 0; i < n_positions; i++) {
+        if ((j == 0) || (positions[i].key != positions[j - 1].key)) {
+            positions[j++] = positions[i];
+        }
+    }
+    n_positions = j;
+
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open book file %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    uint8_t entry[BOOK_ENTRY];
+    memset(entry, 0, sizeof(entry));
+    fwrite(entry, 1, BOOK_HEADER, fp);
+    node_t root;
+    move_t move;
+    for (i = 0; i < n_positions; i++) {
+        move.num = positions[i].move_num;
+        fill_node(&root, &positions[i].bits, &move);
+        search_best_move(search, &root);
+        for (j = 0; j < 8; j++) {
+            entry[j] = positions[i].key >> (8 * j);
+        }
+        for (j = 0; j < 4; j++) {
+            entry[8 + j] = (uint32_t)root.cost >> (8 * j);
+        }
+        entry[12] = tt_pack_move(&root.best_move);
+        entry[13] = search->completed_depth;
+        fwrite(entry, 1, BOOK_ENTRY, fp);
+        n_entries++;
+    }
+
+    /* header written last, once the number of entries is known */
+    memcpy(entry, BOOK_MAGIC, BOOK_MAGIC_LEN);
+    for (j = 0; j < 4; j++) {
+        entry[BOOK_MAGIC_LEN + j] = (uint32_t)n_entries >> (8 * j);
+    }
+    fseek(fp, 0, SEEK_SET);
+    fwrite(entry, 1, BOOK_HEADER, fp);
+    fclose(fp);
+    free(positions);
+    printf("BOOK: %s PLIES: %d POSITIONS: %d DEPTH: %d TIME: %ldms\n", 
+        filename, plies, n_entries, search->depth, now_ms() - elapsed);
+}
+
+/* adds every position with moves, fewer than plies moves below this one, to
+   the positions to search
+*/
+void
+collect_book(search_t *search, bitboard_t *bits, int move_num, int plies, 
+    book_position_t **positions, int *n_positions, int *max_positions) {
+    bits_t steps[QUADS], jumps[QUADS];
+    if ((plies == 0) || !get_move_masks(bits, move_num, steps, jumps)) {
+        return;
+    }
+    if (*n_positions == *max_positions) {
+        *max_positions *= 2;
+        *positions = realloc(*positions, *max_positions * sizeof(**positions));
+        assert(*positions != NULL);
+    }
+    book_position_t *position = &(*positions)[(*n_positions)++];
+    position->key = tt_hash(&search->tt, bits, move_num);
+    position->bits = *bits;
+    position->move_num = move_num;
+
+    arena_mark_t mark = arena_mark(&search->arena);
+    moveset_t moveset;
+    node_t node;
+    move_t move;
+    undo_t undo;
+    int i;
+    move.num = move_num;
+    fill_node(&node, bits, &move);
+    fill_moves_arr(&node, &moveset, &search->arena);
+    for (i = 0; i < moveset.n_moves; i++) {
+        move = moveset.moves_arr[i];
+        bits_make_move(bits, &move, &undo);
+        collect_book(search, bits, move.num, plies - 1, positions, 
+            n_positions, max_positions);
+        bits_unmake_move(bits, &move, &undo);
+    }
+    arena_rewind(&search->arena, mark);
+}
+
+/* orders book positions by key, for qsort
+*/
+int
+compare_book(const void *a, const void *b) {
+    uint64_t key_a = ((book_position_t*)a)->key;
+    uint64_t key_b = ((book_position_t*)b)->key;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+/* TOURNAMENT MODE -----------------------------------------------------------*/
+
+/* plays games between two settings on every core, or the threads given, each
+   random opening twice with the sides swapped, and reports each side's
+   results and speed
+*/
+void
+run_tournament(search_t *search) {
+    tournament_t tournament;
+    int i, n_threads = search->n_threads;
+    tournament.search = search;
+    tournament.n_games = search->match_games;
+    tournament.hash_mb = (search->tt.slots == NULL) ? 0 : 
+        (search->tt.mask + 1) * sizeof(tt_slot_t) / MEGABYTE;
+    for (i = 0; i < 2; i++) {
+        if (!parse_player(search, search->match_specs[i], 
+            &tournament.players[i])) {
+            fprintf(stderr, "malformed settings \"%s\"\n", 
+                search->match_specs[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    atomic_init(&tournament.next, 0);
+    pthread_mutex_init(&tournament.lock, NULL);
+
+    long elapsed = now_ms();
+    worker_t *workers;
+    workers = malloc(n_threads * sizeof(*workers));
+    assert(workers != NULL);
+    for (i = 0; i < n_threads; i++) {
+        workers[i].tournament = &tournament;
+        pthread_create(&workers[i].thread, NULL, tournament_worker, 
+            &workers[i]);
+    }
+    for (i = 0; i < n_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    elapsed = now_ms() - elapsed;
+    free(workers);
+    pthread_mutex_destroy(&tournament.lock);
+
+    printf("TOURNAMENT GAMES: %d THREADS: %d TIME: %ldms GAMES/S: %.1f\n", 
+        tournament.n_games, n_threads, elapsed, 
+        1000.0 * tournament.n_games / (elapsed ? elapsed : 1));
+    print_player(&tournament.players[0], 'A');
+    print_player(&tournament.players[1], 'B');
+}
+
+/* reads a side's settings, returning 0 if they are malformed or ask for
+   tables or a book that were not loaded; a depth of 0 means none was given
+*/
+int
+parse_player(search_t *search, char *spec, player_t *player) {
+    char *end;
+    memset(player, 0, sizeof(*player));
+    player->spec = spec;
+    player->order_moves = 1;
+    while (*spec) {
+        if ((*spec == 'd') || (*spec == 't') || (*spec == 'q')) {
+            long value = strtol(spec + 1, &end, 10);
+            if ((end == spec + 1) || (value < 0) || 
+                ((*spec == 'd') && ((value < 1) || (value > MAX_DEPTH)))) {
+                return 0;
+            }
+            if (*spec == 'd') {
+                player->depth = value;
             }
+            else if (*spec == 't') {
+                player->time_budget = value;
+            }
+            else {
+                player->quiesce_plies = value ? value : MAX_CAPTURES;
+            }
+            spec = end;
+            continue;
+        }
+        else if (*spec == 'n') {
+            player->order_moves = 0;
         }
+        else if ((*spec == 'T') && (search->tb.map != NULL)) {
+            player->tables = 1;
+        }
+        else if ((*spec == 'k') && (search->book.map != NULL)) {
+            player->book = 1;
+        }
+        else {
+            return 0;
+        }
+        spec++;
+    }
+    return 1;
+}
 
-        /* white must capture black */
-        else if ((src_cell == CELL_WPIECE) || (src_cell == CELL_WTOWER)) {
-            if ((cpt_cell != CELL_BPIECE) && (cpt_cell != CELL_BTOWER)) {
-                return illegal_move = 1;
+/* plays the next game until none are left, with a search for each side
+*/
+void*
+tournament_worker(void *arg) {
+    worker_t *worker = arg;
+    tournament_t *tournament = worker->tournament;
+    search_t players[2];
+    int i;
+    for (i = 0; i < 2; i++) {
+        prepare_player(tournament, &tournament->players[i], &players[i]);
+    }
+    while ((i = atomic_fetch_add(&tournament->next, 1)) < 
+        tournament->n_games) {
+        play_game(tournament, players, i);
+    }
+    for (i = 0; i < 2; i++) {
+        arena_free(&players[i].arena);
+        tt_free(&players[i].tt);
+    }
+    return NULL;
+}
+
+/* sets up a side's own search from the tournament's settings, sharing the
+   tables and book but not the hash table
+*/
+void
+prepare_player(tournament_t *tournament, player_t *player, search_t *search) {
+    *search = *tournament->search;
+    arena_init(&search->arena);
+    if (!tt_init(&search->tt, tournament->hash_mb)) {
+        fprintf(stderr, "cannot allocate a %zu MB hash table per player\n", 
+            tournament->hash_mb);
+        exit(EXIT_FAILURE);
+    }
+    search->n_threads = 1;
+    search->lazy_smp = search->measure_efficiency = 0;
+    search->workers = NULL;
+    search->report_memory = search->report_stats = 0;
+    search->json = NULL;
+    search->halt = search->stop = NULL;
+    search->depth = TREE_DEPTH;
+    search->order_moves = player->order_moves;
+    search->time_budget = player->time_budget;
+    search->quiesce_plies = player->quiesce_plies;
+
+    /* as with -t and -d, a time budget deepens until a given depth */
+    if (player->time_budget) {
+        search->depth = MAX_DEPTH;
+        search->tt.exact_depth = 0;
+    }
+    if (player->depth) {
+        search->depth = player->depth;
+    }
+    if (!player->tables) {
+        search->tb.map = NULL;
+    }
+    if (!player->book) {
+        search->book.map = NULL;
+        search->book.n_entries = 0;
+    }
+    memset(search->killers, TT_NO_MOVE, sizeof(search->killers));
+    memset(search->history, 0, sizeof(search->history));
+}
+
+/* plays one game from its pair's random opening, side A taking black in
+   even games, until a side cannot move or the game is too long and drawn
+*/
+void
+play_game(tournament_t *tournament, search_t players[2], int game) {
+    board_t board;
+    bitboard_t bits;
+    node_t root;
+    move_t move;
+    undo_t undo;
+    moveset_t moveset;
+    uint64_t state = game / 2;
+    int ply, side, a_side = game % 2, winner = -1;
+    unsigned long nodes[2] = {0, 0}, moves[2] = {0, 0};
+    long search_ns[2] = {0, 0}, start_ns;
+    bits_t steps[QUADS], jumps[QUADS];
+    set_board(board);
+    board_to_bits(board, &bits);
+    move.num = 0;
+    fill_node(&root, &bits, &move);
+
+    /* the same random opening for both games of a pair */
+    for (ply = 0; ply < OPENING_PLIES; ply++) {
+        fill_moves_arr(&root, &moveset, &players[0].arena);
+        if (moveset.n_moves == 0) {
+            break;
+        }
+        move = moveset.moves_arr[split_mix(&state) % moveset.n_moves];
+        arena_reset(&players[0].arena);
+        fill_node(&root, &bits, &move);
+        bits_make_move(&bits, &root.move, &undo);
+    }
+
+    /* the side to move loses once it has no moves */
+    while (root.move.num < OPENING_PLIES + MAX_GAME_PLIES) {
+        side = root.move.num % 2;
+        if (!get_move_masks(&bits, root.move.num, steps, jumps)) {
+            winner = !side;
+            break;
+        }
+        start_ns = now_ns();
+        search_best_move(&players[side ^ a_side], &root);
+        search_ns[side ^ a_side] += now_ns() - start_ns;
+        nodes[side ^ a_side] += players[side ^ a_side].nodes;
+        moves[side ^ a_side]++;
+        fill_node(&root, &bits, &root.best_move);
+        bits_make_move(&bits, &root.move, &undo);
+    }
+
+    /* totals are kept for sides, not colours */
+    pthread_mutex_lock(&tournament->lock);
+    for (side = 0; side < 2; side++) {
+        player_t *player = &tournament->players[side];
+        if (winner < 0) {
+            player->draws++;
+        }
+        else if ((winner ^ a_side) == side) {
+            player->wins++;
+        }
+        else {
+            player->losses++;
+        }
+        player->nodes += nodes[side];
+        player->moves += moves[side];
+        player->search_ns += search_ns[side];
+    }
+    pthread_mutex_unlock(&tournament->lock);
+}
+
+/* prints a side's results, score and search speed
+*/
+void
+print_player(player_t *player, char name) {
+    unsigned long games = player->wins + player->draws + player->losses;
+    double score = (player->wins + 0.5 * player->draws) / (games ? games : 1);
+    double seconds = player->search_ns / 1e9;
+    printf("%c %s WINS: %lu DRAWS: %lu LOSSES: %lu SCORE: %.1f%% NPS: %.0f "
+        "MS/MOVE: %.3f\n", name, player->spec, player->wins, player->draws, 
+        player->losses, 100.0 * score, 
+        player->nodes / (seconds > 0 ? seconds : 1), 
+        player->search_ns / 1e6 / (player->moves ? player->moves : 1));
+}
+
+/* BATCH MODE ----------------------------------------------------------------*/
+
+/* analyses every game of the batch file on the search threads, printing each
+   result in file order as soon as it and the games before it are done
+*/
+void
+run_batch(search_t *search) {
+    int i, n_games;
+    game_t *games = read_games(search->batch_file, &n_games);
+
+    /* one thread replays and prints each game in turn */
+    if (search->n_threads == 1) {
+        for (i = 0; i < n_games; i++) {
+            analyse_game(search, &games[i]);
+            print_game(&games[i], i + 1);
+        }
+    }
+
+    /* each thread takes the next game, main thread prints them in order */
+    else {
+        batch_t batch;
+        batch.games = games;
+        batch.n_games = n_games;
+        atomic_init(&batch.next, 0);
+        pthread_mutex_init(&batch.lock, NULL);
+        pthread_cond_init(&batch.finished, NULL);
+        worker_t *workers;
+        workers = malloc(search->n_threads * sizeof(*workers));
+        assert(workers != NULL);
+        for (i = 0; i < search->n_threads; i++) {
+            workers[i].search = &search->workers[i];
+            workers[i].batch = &batch;
+            prepare_worker(search, workers[i].search);
+            pthread_create(&workers[i].thread, NULL, batch_worker, 
+                &workers[i]);
+        }
+        for (i = 0; i < n_games; i++) {
+            pthread_mutex_lock(&batch.lock);
+            while (!games[i].done) {
+                pthread_cond_wait(&batch.finished, &batch.lock);
             }
+            pthread_mutex_unlock(&batch.lock);
+            print_game(&games[i], i + 1);
+        }
+        for (i = 0; i < search->n_threads; i++) {
+            pthread_join(workers[i].thread, NULL);
         }
+        pthread_cond_destroy(&batch.finished);
+        pthread_mutex_destroy(&batch.lock);
+        free(workers);
     }
-    return illegal_move = 0;
+
+    for (i = 0; i < n_games; i++) {
+        free(games[i].moves);
+    }
+    free(games);
 }
 
-/* prints type of move error by user
+/* reads a file of games, each a list of moves ended by a command or a blank
+   line and optionally started by a position, skipping malformed lines
+*/
+game_t*
+read_games(char *filename, int *n_games) {
+    input_t input;
+    read_input(filename, &input);
+    char *line, command;
+    int length, max_games = 1, is_position, move_num;
+    game_t *games, *game = NULL;
+    move_t move;
+    board_t board;
+    games = malloc(max_games * sizeof(*games));
+    assert(games != NULL);
+    *n_games = 0;
+
+    while (next_line(&input, &line, &length)) {
+        command = '\0';
+
+        /* a position starts a new game */
+        is_position = parse_position(line, length, board, &move_num);
+        if (is_position) {
+            game = NULL;
+        }
+        else if (!parse_move(line, length, &move)) {
+            command = parse_command(line, length);
+            if (!command && !blank_line(line, length)) {
+                fprintf(stderr, "%s line %d: malformed move \"%.*s\"\n", 
+                    filename, input.line_num, length, line);
+                continue;
+            }
+
+            /* blank line ends the game */
+            if (!command) {
+                game = NULL;
+                continue;
+            }
+        }
+
+        /* first line of a new game */
+        if (game == NULL) {
+            if (*n_games == max_games) {
+                max_games *= 2;
+                games = realloc(games, max_games * sizeof(*games));
+                assert(games != NULL);
+            }
+            game = &games[(*n_games)++];
+            game->n_moves = game->max_moves = 0;
+            game->moves = NULL;
+            game->command = '\0';
+            game->has_position = game->done = 0;
+        }
+        if (is_position) {
+            game->has_position = 1;
+            game->move_num = move_num;
+            board_to_bits(board, &game->bits);
+            continue;
+        }
+
+        /* a command is the last line of its game */
+        if (command) {
+            game->command = command;
+            game = NULL;
+            continue;
+        }
+        if (game->n_moves == game->max_moves) {
+            game->max_moves = game->max_moves ? 2 * game->max_moves : 
+                COMP_ACTIONS;
+            game->moves = realloc(game->moves, game->max_moves * 
+                sizeof(move_t));
+            assert(game->moves != NULL);
+        }
+        game->moves[game->n_moves++] = move;
+    }
+    free_input(&input);
+    return games;
+}
+
+/* analyses games until none are left, flagging each one done
+*/
+void*
+batch_worker(void *arg) {
+    worker_t *worker = arg;
+    batch_t *batch = worker->batch;
+    int i;
+    while ((i = atomic_fetch_add(&batch->next, 1)) < batch->n_games) {
+        analyse_game(worker->search, &batch->games[i]);
+        pthread_mutex_lock(&batch->lock);
+        batch->games[i].done = 1;
+        pthread_cond_broadcast(&batch->finished);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    return NULL;
+}
+
+/* replays a game without printing, stopping at an illegal move or a win, then
+   plays its command's moves, keeping the result in the game
 */
 void
-print_error(int error_num) {
-    if (error_num == 1) {
-        printf("ERROR: Source cell is outside of the board.\n");
+analyse_game(search_t *search, game_t *game) {
+    board_t board;
+    bitboard_t bits;
+    node_t node;
+    move_t move;
+    int i, n_actions;
+    set_board(board);
+    move.num = 0;
+    if (game->has_position) {
+        bits_to_board(&game->bits, board);
+        move.num = game->move_num;
     }
-    else if (error_num == 2) {
-        printf("ERROR: Target cell is outside of the board.\n");
+    game->n_actions = game->n_played = game->error = game->cost = 0;
+
+    /* replay input moves */
+    for (i = 0; i < game->n_moves; i++) {
+        move.src = game->moves[i].src;
+        move.tgt = game->moves[i].tgt;
+        set_move_cells(board, &move);
+        game->error = illegal_move(board, &move);
+        if (game->error) {
+            return;
+        }
+        make_move(board, &move);
+        game->n_actions++;
+        board_to_bits(board, &bits);
+        fill_node(&node, &bits, &move);
+        node.max_depth = 1; // ensure cost accounts for game end
+        game->cost = node_cost(&node);
+        if ((game->cost == INT_MAX) || (game->cost == INT_MIN)) {
+            return;
+        }
     }
-    else if (error_num == 3) {
-        printf("ERROR: Source cell is empty.\n");
+    if (!game->command) {
+        return;
     }
-    else if (error_num == 4) {
-         printf("ERROR: Target cell is not empty.\n");
+
+    /* compute the command's actions, stopping once one wins */
+    n_actions = (game->command == ACTION) ? 1 : COMP_ACTIONS;
+    board_to_bits(board, &bits);
+    fill_node(&node, &bits, &move);
+    for (i = 0; i < n_actions; i++) {
+        search_best_move(search, &node);
+        apply_best_move(&node, board, &move);
+        game->played[game->n_played++] = move;
+        game->cost = node.cost;
+        if ((game->cost == INT_MAX) || (game->cost == INT_MIN)) {
+            return;
+        }
     }
-    else if (error_num == 5) {
-        printf("ERROR: Source cell holds opponent's piece/tower.\n");
+}
+
+/* prints one line with a game's result
+*/
+void
+print_game(game_t *game, int number) {
+    int i;
+    printf("GAME %d: ACTIONS: %d ", number, game->n_actions);
+    if (game->error) {
+        print_error(game->error);
+        return;
     }
-    else if (error_num == 6) {
-        printf("ERROR: Illegal action.\n");
+    if (game->n_played) {
+        printf("PLAYED:");
+        for (i = 0; i < game->n_played; i++) {
+            printf(" %c%d-%c%d", n2a(game->played[i].src.col), 
+                game->played[i].src.row + 1, n2a(game->played[i].tgt.col),
+                game->played[i].tgt.row + 1);
+        }
+        printf(" ");
+    }
+    printf("BOARD COST: %d", game->cost);
+    if (game->cost == INT_MAX) {
+        printf(" BLACK WIN!");
+    }
+    else if (game->cost == INT_MIN) {
+        printf(" WHITE WIN!");
     }
+    printf("\n");
 }
 
-/* applies a move to the board and prints the result
+/* ENGINE MODE ---------------------------------------------------------------*/
+
+/* answers commands on stdin, one per line, keeping the position, tables and
+   arena between them; a search runs on its own thread so stop can end it
 */
 void
-make_move(board_t board, move_t *move) {    
-    int row1, col1, row2, col2;
-    row1 = move->src.row;
-    col1 = move->src.col;
-    row2 = move->tgt.row;
-    col2 = move->tgt.col;
+run_engine(search_t *search) {
+    engine_t engine;
+    char *line = NULL, *command;
+    size_t capacity = 0;
+    engine.search = search;
+    engine.depth = search->depth;
+    engine.exact_depth = search->tt.exact_depth;
+    engine.time_budget = search->time_budget;
+    engine.searching = 0;
+    atomic_init(&engine.stop, 0);
+    engine_new(&engine);
+
+    /* whole lines, so a long moves command is never split and half applied */
+    while (getline(&line, &capacity, stdin) != -1) {
+        command = strtok(line, CMD_DELIMS);
+        if (command == NULL) {
+            continue;
+        }
 
-    /* move piece and clear old position */
-    board[row2][col2] = board[row1][col1];
-    board[row1][col1] = CELL_EMPTY;  
+        /* stop and quit end a running search, others wait for it */
+        if ((strcmp(command, CMD_STOP) == 0) || 
+            (strcmp(command, CMD_QUIT) == 0)) {
+            atomic_store(&engine.stop, 1);
+        }
+        engine_wait(&engine);
+        if (strcmp(command, CMD_QUIT) == 0) {
+            break;
+        }
+        else if (strcmp(command, CMD_STOP) == 0) {
+            continue;
+        }
+        else if (strcmp(command, CMD_NEW) == 0) {
+            engine_new(&engine);
+            printf("ok\n");
+        }
+        else if (strcmp(command, CMD_MOVES) == 0) {
+            engine_moves(&engine);
+        }
+        else if (strcmp(command, CMD_POSITION) == 0) {
+            char *text = strtok(NULL, "\n");
+            if ((text == NULL) || !parse_position(text, strlen(text), 
+                engine.board, &engine.move.num)) {
+                printf("ERROR: Malformed position.\n");
+            }
+            else {
+                board_to_bits(engine.board, &engine.bits);
+                printf("ok\n");
+            }
+        }
+        else if (strcmp(command, CMD_GO) == 0) {
+            engine_go(&engine);
+        }
+        else if (strcmp(command, CMD_BOARD) == 0) {
+            output_t output;
+            output.mode = OUTPUT_FULL;
+            char position[POSITION_TEXT];
+            print_board(&output, engine.board, 0);
+            format_position(engine.board, engine.move.num, position);
+            printf("BOARD COST: %d\nPOSITION: %s\n", cost(&engine.bits), 
+                position);
+        }
+        else {
+            printf("ERROR: Unknown command %s.\n", command);
+        }
+        fflush(stdout);
+    }
+    atomic_store(&engine.stop, 1);
+    engine_wait(&engine);
+    free(line);
+}
+
+/* sets the engine back to the starting board, black to move
+*/
+void
+engine_new(engine_t *engine) {
+    set_board(engine->board);
+    board_to_bits(engine->board, &engine->bits);
+    engine->move.num = 0;
+}
+
+/* applies the moves following the command, all or none of them, answering
+   ok or the first move's error
+*/
+void
+engine_moves(engine_t *engine) {
+    board_t board;
+    bitboard_t bits;
+    move_t move = engine->move, bits_move;
+    undo_t undo;
+    char *word;
+    int error;
+    memcpy(board, engine->board, sizeof(board));
+    bits = engine->bits;
+
+    while ((word = strtok(NULL, CMD_DELIMS)) != NULL) {
+        if (!parse_move(word, strlen(word), &move)) {
+            printf("ERROR: Malformed move %s.\n", word);
+            return;
+        }
+        set_move_cells(board, &move);
+        error = illegal_move(board, &move);
+        if (error) {
+            print_error(error);
+            return;
+        }
+        bits_move = move;
+        bits_make_move(&bits, &bits_move, &undo);
+        make_move(board, &move);
+    }
+    memcpy(engine->board, board, sizeof(board));
+    engine->bits = bits;
+    engine->move = move;
+    printf("ok\n");
+}
+
+/* starts searching the position with this command's depth and time, or
+   answers the winner if the game is over
+*/
+void
+engine_go(engine_t *engine) {
+    search_t *search = engine->search;
+    char *word, *value;
+    search->depth = engine->depth;
+    search->time_budget = engine->time_budget;
+    search->tt.exact_depth = engine->exact_depth;
+    while (((word = strtok(NULL, CMD_DELIMS)) != NULL) && 
+        ((value = strtok(NULL, CMD_DELIMS)) != NULL)) {
+        if (strcmp(word, GO_DEPTH) == 0) {
+            search->depth = atoi(value);
+            search->time_budget = 0;
+        }
+        else if (strcmp(word, GO_TIME) == 0) {
+            search->time_budget = atol(value);
+            search->depth = MAX_DEPTH;
+        }
+    }
+    if ((search->depth < 1) || (search->depth > MAX_DEPTH) || 
+        (search->time_budget < 0)) {
+        printf("ERROR: Illegal search limit.\n");
+        return;
+    }
+
+    /* deeper stored results are only usable when timing already matters */
+    if (search->time_budget) {
+        search->tt.exact_depth = 0;
+    }
+
+    /* game over, nothing to search */
+    fill_node(&engine->root, &engine->bits, &engine->move);
+    engine->root.max_depth = 1;
+    if (node_cost(&engine->root) == INT_MAX) {
+        printf("BLACK WIN!\n");
+        return;
+    }
+    else if (engine->root.cost == INT_MIN) {
+        printf("WHITE WIN!\n");
+        return;
+    }
+    atomic_store(&engine->stop, 0);
+    search->stop = &engine->stop;
+    engine->searching = 1;
+    pthread_create(&engine->thread, NULL, engine_search, engine);
+}
+
+/* searches the engine's position and answers its best move
+*/
+void*
+engine_search(void *arg) {
+    engine_t *engine = arg;
+    search_t *search = engine->search;
+    node_t *root = &engine->root;
+    long elapsed = now_ms();
+    search_best_move(search, root);
+    elapsed = now_ms() - elapsed;
+    printf("bestmove %c%d-%c%d cost %d depth %d nodes %lu time %ldms\n", 
+        n2a(root->best_move.src.col), root->best_move.src.row + 1, 
+        n2a(root->best_move.tgt.col), root->best_move.tgt.row + 1, 
+        root->cost, search->completed_depth, search->nodes, elapsed);
+    fflush(stdout);
+    return NULL;
+}
+
+/* waits for a running search to answer
+*/
+void
+engine_wait(engine_t *engine) {
+    if (engine->searching) {
+        pthread_join(engine->thread, NULL);
+        engine->searching = 0;
+        engine->search->stop = NULL;
+    }
+}
+
+/* stage 0 helper functions ------------------------------------------------- */
+
+/* assigns a move's cells, only reading the board when inside it
+*/
+void
+set_move_cells(board_t board, move_t *move) {
+    move->src.cell = move->tgt.cell = CELL_EMPTY;
+    if (on_board(move->src.row, move->src.col)) {
+        move->src.cell = board[move->src.row][move->src.col];
+    }
+    if (on_board(move->tgt.row, move->tgt.col)) {
+        move->tgt.cell = board[move->tgt.row][move->tgt.col];
+    }
+}
+
+/* checks if move is illegal or not
+*/
+int
+illegal_move(board_t board, move_t *move) {    
+    int row1, row2, col1, col2, next_move_num, error;
+    char src_cell = move->src.cell;
+    char tgt_cell = move->tgt.cell;
+    row1 = move->src.row;
+    row2 = move->tgt.row;
+    col1 = move->src.col;
+    col2 = move->tgt.col;
+    next_move_num = move->num + 1;
+
+    /* ERROR #1: source cell is outside of the board */
+    if (!on_board(row1, col1)) {
+        return error = 1;
+    }
+
+    /* ERROR #2: target cell is outside of the board */
+    if (!on_board(row2, col2)) {
+        return error = 2;
+    }
+
+    /* ERROR #3: source cell is empty */
+    if (src_cell == CELL_EMPTY) {
+        return error = 3;
+    }
+
+    /* ERROR #4: target cell is not empty */
+    if (tgt_cell != CELL_EMPTY) {
+        return error = 4;
+    }
+
+    /* ERROR #5: source cell holds opponent's piece/tower */
+    
+    /* white turn, moving black piece */
+    if (next_move_num % 2 == 0) {
+        if ((src_cell == CELL_BPIECE) || (src_cell == CELL_BTOWER)) {
+            return error = 5;
+        }
+    }
+
+    /* black turn, moving white piece */
+    else {
+        if ((src_cell == CELL_WPIECE) || (src_cell == CELL_WTOWER)) {
+            return error = 5;
+        }
+    }
+
+    /* ERROR #6: illegal action */
+    int misc_illegal = misc_illegal_move(board, move);
+    if (misc_illegal) {
+        return error = 6;
+    }
+    return error = 0;
+}
+
+/* checks other conditions for legal move
+*/
+int
+misc_illegal_move(board_t board, move_t *move) {
+    int row1, row2, col1, col2, row_jump, col_jump, illegal_move;
+    row1 = move->src.row;
+    row2 = move->tgt.row;
+    col1 = move->src.col;
+    col2 = move->tgt.col;
+    row_jump = row2 - row1;
+    col_jump = col2 - col1;
+    char src_cell = board[row1][col1];
+
+    /* piece is not moving diagonally (1:1) */
+    if (abs(row_jump) != abs(col_jump)) {
+        return illegal_move = 1;
+    }
+    
+    /* piece is moving in wrong direction  */
+    if ((src_cell == CELL_WPIECE) && (row_jump <= 0)) {
+        return illegal_move = 1;    
+    }
+    else if ((src_cell == CELL_BPIECE) && (row_jump >= 0)) {
+        return illegal_move = 1;
+    }
+
+    /* piece has jumped too far */
+    if (row_jump > CAPTURE_JUMP) {
+        return illegal_move = 1;    
+    }
+    
+    /* a capture is being attempted */
+    if (abs(row_jump) == CAPTURE_JUMP) {
+        char cpt_cell = board[(row1 + row2) / 2][(col1 + col2) / 2];
+
+        /* black must capture white */
+        if ((src_cell == CELL_BPIECE) || (src_cell == CELL_BTOWER)) {
+            if ((cpt_cell != CELL_WPIECE) && (cpt_cell != CELL_WTOWER)) {
+                return illegal_move = 1;
+            }
+        }
+
+        /* white must capture black */
+        else if ((src_cell == CELL_WPIECE) || (src_cell == CELL_WTOWER)) {
+            if ((cpt_cell != CELL_BPIECE) && (cpt_cell != CELL_BTOWER)) {
+                return illegal_move = 1;
+            }
+        }
+    }
+    return illegal_move = 0;
+}
+
+/* prints type of move error by user
+*/
+void
+print_error(int error_num) {
+    if (error_num == 1) {
+        printf("ERROR: Source cell is outside of the board.\n");
+    }
+    else if (error_num == 2) {
+        printf("ERROR: Target cell is outside of the board.\n");
+    }
+    else if (error_num == 3) {
+        printf("ERROR: Source cell is empty.\n");
+    }
+    else if (error_num == 4) {
+         printf("ERROR: Target cell is not empty.\n");
+    }
+    else if (error_num == 5) {
+        printf("ERROR: Source cell holds opponent's piece/tower.\n");
+    }
+    else if (error_num == 6) {
+        printf("ERROR: Illegal action.\n");
+    }
+}
+
+/* applies a move to the board and prints the result
+*/
+void
+make_move(board_t board, move_t *move) {    
+    int row1, col1, row2, col2;
+    row1 = move->src.row;
+    col1 = move->src.col;
+    row2 = move->tgt.row;
+    col2 = move->tgt.col;
+
+    /* move piece and clear old position */
+    board[row2][col2] = board[row1][col1];
+    board[row1][col1] = CELL_EMPTY;  
+
+    /* check if a capture was made */ 
+    if (abs(row2 - row1) == abs(CAPTURE_JUMP)) {
+    
+        /* remove piece from play */
+        board[(row1 + row2) / 2][(col1 + col2) / 2] = CELL_EMPTY;
+    }
+    check_tower(board, move);
+    move->num++;
+}
+
+/* changes a piece to a tower if the necessary move is made
+*/
+void
+check_tower(board_t board, move_t *move) {
+    char piece;
+    piece = board[move->tgt.row][move->tgt.col];
+
+    if (piece == CELL_BTOWER || piece == CELL_WTOWER) {
+        return;
+    }
+
+    if (piece == CELL_BPIECE && move->tgt.row == 0) {
+        piece = CELL_BTOWER;
+    }
+    else if (piece == CELL_WPIECE && move->tgt.row == ROWS - 1) {
+        piece = CELL_WTOWER;
+    }
+    board[move->tgt.row][move->tgt.col] = piece;
+}
+
+/* prints information about current board, in full or on one line, or keeps
+   the line to print at the end when silent
+*/
+void
+print_move_info(output_t *output, board_t board, move_t *move, int cost, 
+    int minimax_move) {
+    char text[MAX_LINE], *end = text;
+    int row1, row2;
+    char col1, col2;
+
+    /* convert index values to output values */
+    row1 = move->src.row + 1;
+    row2 = move->tgt.row + 1;
+    col1 = n2a(move->src.col);
+    col2 = n2a(move->tgt.col);
+
+    /* delimiter */
+    if (output->mode == OUTPUT_FULL) {
+        end += sprintf(end, "=====================================\n");
+    }
+    if (minimax_move) {
+        end += sprintf(end, "*** ");
+    }
+    end += sprintf(end, "%s ACTION #%d: %c%d-%c%d", ((move->num % 2) == 0) ? 
+        "WHITE" : "BLACK", move->num, col1, row1, col2, row2);
+    end += sprintf(end, (output->mode == OUTPUT_FULL) ? "\nBOARD COST: %d\n" :
+        " BOARD COST: %d\n", cost);
+    if (output->mode == OUTPUT_SILENT) {
+        strcpy(output->last, text);
+        return;
+    }
+    fwrite(text, 1, end - text, stdout);
+}
+
+/* prints the move kept back by silent mode, if there is one
+*/
+void
+print_last(output_t *output) {
+    if (output->last[0] != '\0') {
+        fputs(output->last, stdout);
+        output->last[0] = '\0';
+    }
+}
+
+/* calculates cost of the board
+*/
+int
+node_cost(node_t* node) {
+
+    /* determine if previous move ended the game */
+    if (node->max_depth) {
+        
+        /* check if other player has moves in current state */
+        bits_t steps[QUADS], jumps[QUADS];
+        node->num_children = get_move_masks(node->bits, node->move.num,
+            steps, jumps);
+    }
+
+    /* player has no available moves */ 
+    if (node->num_children == 0) {
+
+        /* black to move, they lose */
+        if (node->move.num % 2 == 0) {  
+            node->cost = INT_MIN;
+        }
+
+        /* white to move, they lose */
+        else {
+            node->cost = INT_MAX;
+        }
+        return node->cost;
+    }
+
+    /* game did not end, calculate cost */
+    node->cost = cost(node->bits);
+    return node->cost;
+}
+
+/* sums the total cost of the board from its material counts
+*/
+int
+cost(bitboard_t *bits) {
+    int bP, bT, wP, wT;
+    bP = bits->material[TYPE_BPIECE];
+    bT = bits->material[TYPE_BTOWER];
+    wP = bits->material[TYPE_WPIECE];
+    wT = bits->material[TYPE_WTOWER];
+
+    /* calculate cost according to formula */
+    return ((bP * COST_PIECE) + (bT * COST_TOWER) - (wP * COST_PIECE) - 
+        (wT * COST_TOWER));
+}
+
+/* prints the winner and returns 1 if a player has won
+*/
+int
+check_winner(output_t *output, node_t *node) {
+    if ((node->cost == INT_MAX) || (node->cost == INT_MIN)) {
+        print_last(output);
+        if (output->record != NULL) {
+            output->record->result = (node->cost == INT_MAX) ? 
+                RESULT_BLACK_WIN : RESULT_WHITE_WIN;
+        }
+    }
+    if (node->cost == INT_MAX) {
+        printf("BLACK WIN!\n");
+        return 1;
+    }
+    else if (node->cost == INT_MIN) {
+        printf("WHITE WIN!\n");
+        return 1;
+    }
+    else {
+        return 0;
+    }
+}
+
+/* stage 1 & 2 helper functions ----------------------------------------------*/
+
+/* searches to depth 1, 2, 3 ... until the depth limit or time budget is 
+   reached, keeping the best move of the last completed iteration
+*/
+void
+iterate_search(search_t *search, node_t *root) {
+    move_t best_move;
+    int depth, best_cost = 0;
+    long elapsed;
+    search->start_ms = now_ms();
+    reset_counters(search);
+    search->can_stop = search->stopped = 0;
+    search->completed_depth = search->reused_depth = 0;
+    age_order(search);
+
+    /* the last move's search already has the root's result to some depth,
+       so its iterations are not repeated and only deeper ones are run */
+    tt_entry_t entry;
+    if (tt_probe(&search->tt, root->hash, &entry) && 
+        (entry.bound == TT_EXACT) && tt_unpack_move(entry.move, &best_move)) {
+        best_move.num = root->move.num;
+        best_move.src.cell = bits_cell(root->bits, 
+            SQUARE(best_move.src.row, best_move.src.col));
+        best_move.tgt.cell = CELL_EMPTY;
+        best_cost = entry.score;
+        search->reused_depth = (entry.depth < search->depth) ? entry.depth :
+            search->depth - 1;
+        search->completed_depth = search->reused_depth;
+        search->can_stop = (search->time_budget > 0);
+        search->halt = search->stop;
+    }
+
+    for (depth = search->reused_depth + 1; depth <= search->depth; depth++) {
+        if ((search->n_threads > 1) && search->lazy_smp) {
+            lazy_search(search, root, depth);
+        }
+        else if (search->n_threads > 1) {
+            split_search(search, root, depth);
+        }
+        else if (search->pvs && (depth > 1)) {
+            aspiration_search(search, root, depth, best_cost);
+        }
+        else {
+            search_cost(search, root, depth, 0, INT_MIN, INT_MAX);
+        }
+
+        /* ran out of time part way through, discard this iteration */
+        if (search->stopped) {
+            break;
+        }
+        best_move = root->best_move;
+        best_cost = root->cost;
+        search->completed_depth = depth;
+        elapsed = now_ms() - search->start_ms;
+        if (search->report_stats) {
+            fprintf(stderr, "DEPTH: %d COST: %d NODES: %lu TIME: %ldms "
+                "CUTOFFS: %lu FIRST MOVE: %.1f%%\n", depth, best_cost, 
+                search->nodes, elapsed, search->cutoffs, search->cutoffs ? 
+                100.0 * search->first_cutoffs / search->cutoffs : 0.0);
+            if (search->quiesce_plies) {
+                fprintf(stderr, "QUIESCENCE NODES: %lu\n", 
+                    search->quiesce_nodes);
+            }
+        }
+
+        /* with a time budget, stop once the game is decided or the next
+           iteration cannot finish in time */
+        if (search->time_budget && ((best_cost == INT_MAX) || 
+            (best_cost == INT_MIN) || (2 * elapsed >= search->time_budget))) {
+            break;
+        }
+
+        /* a move is known now, later iterations may be abandoned */
+        search->can_stop = (search->time_budget > 0);
+        search->halt = search->stop;
+    }
+    search->halt = NULL;
+    root->best_move = best_move;
+    root->cost = best_cost;
+}
+
+/* searches the root with a narrow window around the last iteration's cost,
+   searching again with the full window if the cost falls outside it
+*/
+void
+aspiration_search(search_t *search, node_t *root, int depth, int last_cost) {
+    int low = INT_MIN, high = INT_MAX;
+    if (last_cost > INT_MIN + ASPIRATION_WINDOW) {
+        low = last_cost - ASPIRATION_WINDOW;
+    }
+    if (last_cost < INT_MAX - ASPIRATION_WINDOW) {
+        high = last_cost + ASPIRATION_WINDOW;
+    }
+    search_cost(search, root, depth, 0, low, high);
+    if (!search->stopped && (((root->cost <= low) && (low > INT_MIN)) || 
+        ((root->cost >= high) && (high < INT_MAX)))) {
+        search->aspiration_fails++;
+        search_cost(search, root, depth, 0, INT_MIN, INT_MAX);
+    }
+}
+
+/* searches the root's moves in parallel, each thread taking the next most
+   promising move, with the best cost so far shared as the root's bound
+*/
+void
+split_search(search_t *search, node_t *root, int depth) {
+    int i, n_moves;
+    search->nodes++;
+
+    /* generate and order root moves once for all threads */
+    arena_mark_t mark = arena_mark(&search->arena);
+    tt_entry_t entry;
+    uint8_t hash_move = TT_NO_MOVE;
+    if (tt_probe(&search->tt, root->hash, &entry)) {
+        hash_move = entry.move;
+    }
+    moveset_t *moveset;
+    moveset = arena_alloc(&search->arena, sizeof(*moveset));
+    moveset->moves_arr = fill_moves_arr(root, moveset, &search->arena);
+    n_moves = root->num_children = moveset->n_moves;
+    if (n_moves == 0) {
+        arena_rewind(&search->arena, mark);
+        search_cost(search, root, depth, 0, INT_MIN, INT_MAX);
+        return;
+    }
+    int *scores = score_moves(search, root, moveset, hash_move, 0);
+    split_t split;
+    split.order = arena_alloc(&search->arena, n_moves * sizeof(int));
+    for (i = 0; i < n_moves; i++) {
+        split.order[i] = pick_move(scores, n_moves);
+    }
+
+    /* start from a losing position and the first generated move */
+    split.root = root;
+    split.moveset = moveset;
+    split.depth = depth;
+    split.black = (root->move.num % 2 == 0);
+    split.cost = split.black ? INT_MIN : INT_MAX;
+    split.best_index = 0;
+    atomic_init(&split.next, 0);
+    atomic_init(&split.bound, split.cost);
+    pthread_mutex_init(&split.lock, NULL);
+
+    /* run the threads and collect their results */
+    worker_t *workers;
+    workers = arena_alloc(&search->arena, search->n_threads * 
+        sizeof(worker_t));
+    for (i = 0; i < search->n_threads; i++) {
+        workers[i].search = &search->workers[i];
+        workers[i].split = &split;
+        workers[i].bits = *root->bits;
+        prepare_worker(search, workers[i].search);
+        workers[i].search->root_bound = &split.bound;
+        pthread_create(&workers[i].thread, NULL, split_worker, &workers[i]);
+    }
+    for (i = 0; i < search->n_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        merge_worker(search, workers[i].search);
+        search->stopped |= workers[i].search->stopped;
+    }
+    pthread_mutex_destroy(&split.lock);
+    if (search->report_stats) {
+        print_thread_nodes(search, 0);
+    }
+
+    root->cost = split.cost;
+    root->best_move = moveset->moves_arr[split.best_index];
+    if (!search->stopped) {
+        tt_store(&search->tt, root, depth, TT_EXACT);
+    }
+    arena_rewind(&search->arena, mark);
+}
+
+/* takes root moves until none are left, searching each on its own board;
+   ties go to the move generated first exactly as in search_cost, so the
+   chosen move does not depend on which thread finishes first
+*/
+void*
+split_worker(void *arg) {
+    worker_t *worker = arg;
+    split_t *split = worker->split;
+    search_t *search = worker->search;
+    move_t *moves = split->moveset->moves_arr;
+    int i, j, tie_wins, decided, child_max, child_min, child_cost;
+    node_t child;
+    undo_t undo;
+
+    while ((i = atomic_fetch_add(&split->next, 1)) < 
+        split->moveset->n_moves) {
+        j = split->order[i];
+
+        /* window from the best root move found so far */
+        pthread_mutex_lock(&split->lock);
+        tie_wins = (j < split->best_index);
+        decided = (split->cost == (split->black ? INT_MAX : INT_MIN));
+        child_max = split->black ? split->cost : INT_MIN;
+        child_min = split->black ? INT_MAX : split->cost;
+        pthread_mutex_unlock(&split->lock);
+        if (decided && !tie_wins) {
+            continue;
+        }
+        if (tie_wins && split->black && (child_max > INT_MIN)) {
+            child_max--;
+        }
+        else if (tie_wins && !split->black && (child_min < INT_MAX)) {
+            child_min++;
+        }
+
+        /* search the move on this thread's board */
+        fill_node(&child, &worker->bits, &moves[j]);
+        bits_make_move(&worker->bits, &child.move, &undo);
+        child.hash = tt_update_hash(&search->tt, split->root->hash, &undo);
+        child_cost = search_cost(search, &child, split->depth - 1, 1, 
+            child_max, child_min);
+        bits_unmake_move(&worker->bits, &child.move, &undo);
+        if (search->stopped) {
+            break;
+        }
+
+        /* keep the better move, or the earlier generated one on a tie */
+        pthread_mutex_lock(&split->lock);
+        if ((split->black && (child_cost > split->cost)) ||
+            (!split->black && (child_cost < split->cost)) ||
+            ((child_cost == split->cost) && (j < split->best_index))) {
+            split->cost = child_cost;
+            split->best_index = j;
+            atomic_store_explicit(&split->bound, child_cost, 
+                memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&split->lock);
+    }
+    return NULL;
+}
+
+/* searches the whole tree on every thread, sharing the hash table: helpers
+   alternate between the iteration's depth and one deeper, filling the table
+   with results the main thread can use, and stop when it finishes
+*/
+void
+lazy_search(search_t *search, node_t *root, int depth) {
+    int i, n_helpers = search->n_threads - 1;
+    unsigned long main_nodes = search->nodes;
+    atomic_int halt;
+    atomic_init(&halt, 0);
+
+    /* start helpers on their own boards */
+    arena_mark_t mark = arena_mark(&search->arena);
+    worker_t *helpers;
+    helpers = arena_alloc(&search->arena, n_helpers * sizeof(worker_t));
+    for (i = 0; i < n_helpers; i++) {
+        helpers[i].search = &search->workers[i + 1];
+        prepare_worker(search, helpers[i].search);
+        helpers[i].search->halt = &halt;
+        helpers[i].bits = *root->bits;
+        helpers[i].root = *root;
+        helpers[i].root.bits = &helpers[i].bits;
+        helpers[i].depth = depth + (i % 2 == 0);
+        pthread_create(&helpers[i].thread, NULL, lazy_helper, &helpers[i]);
+    }
+
+    /* main thread's search decides the move */
+    search_cost(search, root, depth, 0, INT_MIN, INT_MAX);
+    main_nodes = search->nodes - main_nodes;
+    atomic_store(&halt, 1);
+    for (i = 0; i < n_helpers; i++) {
+        pthread_join(helpers[i].thread, NULL);
+        merge_worker(search, helpers[i].search);
+    }
+    if (search->report_stats) {
+        print_thread_nodes(search, main_nodes);
+    }
+    arena_rewind(&search->arena, mark);
+}
+
+/* searches from a copy of the root until done or halted, the result is only
+   left in the hash table
+*/
+void*
+lazy_helper(void *arg) {
+    worker_t *helper = arg;
+    search_cost(helper->search, &helper->root, helper->depth, 0, INT_MIN, 
+        INT_MAX);
+    return NULL;
+}
+
+/* copies the search settings, table and ordering tables into a thread's
+   search, keeping the thread's own arena
+*/
+void
+prepare_worker(search_t *search, search_t *worker) {
+    arena_t arena = worker->arena;
+    *worker = *search;
+    worker->arena = arena;
+    worker->n_threads = 1;
+    worker->workers = NULL;
+    reset_counters(worker);
+    worker->arena.allocs = 0;
+    worker->json = NULL;
+    memset(&worker->tt.stats, 0, sizeof(worker->tt.stats));
+}
+
+/* zeroes the counters reported after each move, ready for the next search
+*/
+void
+reset_counters(search_t *search) {
+    search->nodes = search->cutoffs = search->first_cutoffs = 0;
+    search->expanded = search->leaves = search->tb_hits = 0;
+    search->quiesce_nodes = search->researches = search->aspiration_fails = 0;
+    search->generate_ns = search->evaluate_ns = 0;
+}
+
+/* adds a thread's counters to the search
+*/
+void
+merge_worker(search_t *search, search_t *worker) {
+    tt_stats_t *stats = &search->tt.stats, *add = &worker->tt.stats;
+    search->nodes += worker->nodes;
+    search->cutoffs += worker->cutoffs;
+    search->first_cutoffs += worker->first_cutoffs;
+    search->expanded += worker->expanded;
+    search->leaves += worker->leaves;
+    search->tb_hits += worker->tb_hits;
+    search->quiesce_nodes += worker->quiesce_nodes;
+    search->researches += worker->researches;
+    search->generate_ns += worker->generate_ns;
+    search->evaluate_ns += worker->evaluate_ns;
+    search->arena.allocs += worker->arena.allocs;
+    stats->probes += add->probes;
+    stats->hits += add->hits;
+    stats->cutoffs += add->cutoffs;
+    stats->collisions += add->collisions;
+    stats->stores += add->stores;
+    stats->replacements += add->replacements;
+    stats->skipped += add->skipped;
+    stats->reused += add->reused;
+}
+
+/* prints how many nodes each thread searched in the last iteration, the
+   main thread first when it searched too
+*/
+void
+print_thread_nodes(search_t *search, unsigned long main_nodes) {
+    int i;
+    fprintf(stderr, "THREAD NODES:");
+    if (search->lazy_smp) {
+        fprintf(stderr, " %lu", main_nodes);
+    }
+    for (i = search->lazy_smp; i < search->n_threads; i++) {
+        fprintf(stderr, " %lu", search->workers[i].nodes);
+    }
+    fprintf(stderr, "\n");
+}
+
+/* searches the same root again on one thread from an empty table to the depth
+   the threads completed, and reports the speedup and efficiency
+*/
+void
+measure_efficiency(search_t *search, node_t *root, long parallel_ms) {
+    node_t saved_root = *root;
+    search_t saved = *search;
+    long serial_ms;
+
+    /* keep the parallel search's counters, reporting only the comparison */
+    search->n_threads = 1;
+    search->time_budget = 0;
+    search->report_stats = 0;
+    search->depth = search->completed_depth;
+    tt_clear(&search->tt);
+    serial_ms = now_ms();
+    iterate_search(search, root);
+    serial_ms = now_ms() - serial_ms;
+
+    fprintf(stderr, "PARALLEL DEPTH: %d THREADS: %d TIME: %ldms "
+        "SERIAL TIME: %ldms NODES: %lu SERIAL NODES: %lu SPEEDUP: %.2f "
+        "EFFICIENCY: %.1f%%\n", search->depth, saved.n_threads, parallel_ms, 
+        serial_ms, saved.nodes, search->nodes, 
+        (double)serial_ms / (parallel_ms ? parallel_ms : 1),
+        100.0 * serial_ms / ((parallel_ms ? parallel_ms : 1) * 
+        saved.n_threads));
+    saved.arena = search->arena;
+    memcpy(saved.killers, search->killers, sizeof(saved.killers));
+    memcpy(saved.history, search->history, sizeof(saved.history));
+    *search = saved;
+    *root = saved_root;
+}
+
+/* writes one JSON line of statistics for the move just played
+*/
+void
+print_json(search_t *search, node_t *root, long search_ns, long output_ns) {
+    tt_stats_t *stats = &search->tt.stats;
+    move_t *move = &root->move;
+    fprintf(search->json, "{\"move\":%d,\"side\":\"%s\",\"best\":"
+        "\"%c%d-%c%d\",\"cost\":%d,\"depth\":%d,\"threads\":%d,", 
+        move->num, (move->num % 2 == 0) ? "white" : "black", 
+        n2a(move->src.col), move->src.row + 1, n2a(move->tgt.col), 
+        move->tgt.row + 1, root->cost, search->completed_depth, 
+        search->n_threads);
+    fprintf(search->json, "\"nodes\":%lu,\"expanded\":%lu,\"leaves\":%lu,"
+        "\"cutoffs\":%lu,\"first_cutoffs\":%lu,", search->nodes, 
+        search->expanded, search->leaves, search->cutoffs, 
+        search->first_cutoffs);
+    fprintf(search->json, "\"tt_probes\":%lu,\"tt_hits\":%lu,"
+        "\"tt_cutoffs\":%lu,\"tt_stores\":%lu,\"tt_reused\":%lu,"
+        "\"reused_depth\":%d,", stats->probes, stats->hits, stats->cutoffs, 
+        stats->stores, stats->reused, search->reused_depth);
+    fprintf(search->json, "\"tb_hits\":%lu,\"book\":%d,\"quiesce_nodes\":%lu,",
+        search->tb_hits, search->book_move, search->quiesce_nodes);
+    fprintf(search->json, "\"researches\":%lu,\"aspiration_fails\":%lu,",
+        search->researches, search->aspiration_fails);
+    fprintf(search->json, "\"arena_allocs\":%lu,\"arena_high_water\":%lu,",
+        search->arena.allocs, (unsigned long)search->arena.high_water);
+    fprintf(search->json, "\"generate_ns\":%ld,\"evaluate_ns\":%ld,"
+        "\"search_ns\":%ld,\"output_ns\":%ld}\n", search->generate_ns,
+        search->evaluate_ns, search_ns, output_ns);
+}
+
+/* finds minimax cost of a node with alpha-beta pruning, searching depth-first
+   and generating each node's children only when it is visited
+*/
+int
+search_cost(search_t *search, node_t *node, int depth, int ply, int best_max, 
+    int best_min) {
+
+    /* check the clock every so often once a move is known, and whether a
+       lazy SMP helper is no longer needed */
+    search->nodes++;
+    if (search->can_stop && ((search->nodes & TIME_CHECK_MASK) == 0) && 
+        (now_ms() - search->start_ms >= search->time_budget)) {
+        search->stopped = 1;
+    }
+    if ((search->halt != NULL) && 
+        atomic_load_explicit(search->halt, memory_order_relaxed)) {
+        search->stopped = 1;
+    }
+    if (search->stopped) {
+        return 0;
+    }
+
+    /* few pieces are left, the endgame tables know the exact result */
+    if ((ply > 0) && tb_probe(&search->tb, node)) {
+        search->tb_hits++;
+        return node->cost;
+    }
+
+    /* leaf node, cost accounts for game end, timed only if reported */
+    long start_ns;
+    if (depth == 0) {
+        node->max_depth = 1;
+        search->leaves++;
+        if (search->quiesce_plies) {
+            return quiesce(search, node, search->quiesce_plies, best_max, 
+                best_min);
+        }
+        if (search->json == NULL) {
+            return node_cost(node);
+        }
+        start_ns = now_ns();
+        node_cost(node);
+        search->evaluate_ns += now_ns() - start_ns;
+        return node->cost;
+    }
+
+    /* position already searched deep enough, the root always searches */
+    int orig_max = best_max, orig_min = best_min;
+    tt_entry_t entry;
+    int stored = tt_probe(&search->tt, node->hash, &entry);
+    uint8_t hash_move = stored ? entry.move : TT_NO_MOVE;
+    if ((ply > 0) && stored && 
+        tt_cutoff(&search->tt, &entry, depth, best_max, best_min)) {
+        return entry.score;
+    }
+
+    /* generate moves for this node only, memory is given back on return */
+    arena_mark_t mark = arena_mark(&search->arena);
+    moveset_t *moveset;
+    moveset = arena_alloc(&search->arena, sizeof(*moveset));
+    start_ns = (search->json != NULL) ? now_ns() : 0;
+    moveset->moves_arr = fill_moves_arr(node, moveset, &search->arena);
+    if (search->json != NULL) {
+        search->generate_ns += now_ns() - start_ns;
+    }
+    search->expanded++;
+    node->num_children = moveset->n_moves;
+
+    /* no moves can be made */
+    if (node->num_children == 0) {
+        arena_rewind(&search->arena, mark);
+        node->max_depth = 0;
+        node_cost(node);
+        tt_store(&search->tt, node, depth, TT_EXACT);
+        return node->cost;
+    }
+
+    /* black to move maximises cost, white to move minimises it, starting
+       from a losing position and choosing the first child if all lose */
+    int i, j, child_cost, black = (node->move.num % 2 == 0);
+    int best_index = 0, tie_wins, child_max, child_min, null_window;
+    int *scores = score_moves(search, node, moveset, hash_move, ply);
+    node->cost = black ? INT_MIN : INT_MAX;
+    node->best_move = moveset->moves_arr[0];
+    node_t *child;
+    undo_t undo;
+    child = arena_alloc(&search->arena, sizeof(*child));
+    for (i = 0; i < node->num_children; i++) {
+
+        /* below a split root, a root move another thread has finished
+           narrows this one's window as it goes, one wider so ties show */
+        if ((ply == 1) && (i > 0) && (search->root_bound != NULL)) {
+            int bound = atomic_load_explicit(search->root_bound, 
+                memory_order_relaxed);
+            if (black && (bound < INT_MAX) && (bound + 1 < best_min)) {
+                best_min = orig_min = bound + 1;
+            }
+            else if (!black && (bound > INT_MIN) && (bound - 1 > best_max)) {
+                best_max = orig_max = bound - 1;
+            }
+            if (best_min <= best_max) {
+                break;
+            }
+        }
+
+        /* search the most promising move left */
+        j = pick_move(scores, node->num_children);
+
+        /* at the root a tie goes to the move generated first, as it would
+           unordered, so earlier moves are searched one wider to see ties */
+        tie_wins = (ply == 0) && (j < best_index);
+        child_max = best_max;
+        child_min = best_min;
+        if (tie_wins && black && (best_max > INT_MIN)) {
+            child_max--;
+        }
+        else if (tie_wins && !black && (best_min < INT_MAX)) {
+            child_min++;
+        }
+
+        /* the root skips moves once its window is empty, which an
+           aspiration window can make happen before a win is found */
+        if ((ply == 0) && (child_min <= child_max)) {
+            continue;
+        }
+
+        /* below the root, later moves only need showing to be no better
+           than the first, unless they are */
+        null_window = search->pvs && (ply > 0) && (i > 0);
+        if (null_window && black) {
+            child_min = best_max + 1;
+        }
+        else if (null_window) {
+            child_max = best_min - 1;
+        }
+
+        /* make the move on the shared board and take it back after */
+        fill_node(child, node->bits, &moveset->moves_arr[j]);
+        bits_make_move(node->bits, &child->move, &undo);
+        child->hash = tt_update_hash(&search->tt, node->hash, &undo);
+        child_cost = search_cost(search, child, depth - 1, ply + 1, child_max,
+            child_min);
+        if (null_window && !search->stopped && (child_cost > best_max) && 
+            (child_cost < best_min)) {
+            search->researches++;
+            child_cost = search_cost(search, child, depth - 1, ply + 1, 
+                best_max, best_min);
+        }
+        bits_unmake_move(node->bits, &child->move, &undo);
+
+        /* out of time, result is incomplete so is not kept */
+        if (search->stopped) {
+            arena_rewind(&search->arena, mark);
+            return 0;
+        }
+
+        /* update node if child cost is better than current cost */
+        if (black && ((child_cost > node->cost) || 
+            (tie_wins && (child_cost == node->cost)))) {
+            node->cost = child_cost;
+            node->best_move = moveset->moves_arr[j];
+            best_index = j;
+            if (node->cost > best_max) {
+                best_max = node->cost;
+            }
+        }
+        else if (!black && ((child_cost < node->cost) || 
+            (tie_wins && (child_cost == node->cost)))) {
+            node->cost = child_cost;
+            node->best_move = moveset->moves_arr[j];
+            best_index = j;
+            if (node->cost < best_min) {
+                best_min = node->cost;
+            }
+        }
+
+        /* opponent has a better move, don't need to compute further costs */
+        if ((best_min <= best_max) && (ply > 0)) {
+            search->cutoffs++;
+            search->first_cutoffs += (i == 0);
+            update_order(search, node, &moveset->moves_arr[j], depth, ply);
+            break;
+        }
+    }
+    arena_rewind(&search->arena, mark);
+
+    /* remember result, bounded if it fell outside the window */
+    if (node->cost <= orig_max) {
+        tt_store(&search->tt, node, depth, TT_UPPER);
+    }
+    else if (node->cost >= orig_min) {
+        tt_store(&search->tt, node, depth, TT_LOWER);
+    }
+    else {
+        tt_store(&search->tt, node, depth, TT_EXACT);
+    }
+    return node->cost;
+}
+
+/* scores a leaf once its pending captures are played out, either side free
+   to stop capturing and take the position's cost, at most plies captures
+   deep and with the same bounds as the search
+*/
+int
+quiesce(search_t *search, node_t *node, int plies, int best_max, 
+    int best_min) {
+    bits_t steps[QUADS], jumps[QUADS], movers;
+    int quad, src, tgt, child_cost, black = (node->move.num % 2 == 0);
+    search->quiesce_nodes++;
+
+    /* standing pat is the position's cost, or the game's end */
+    node->num_children = get_move_masks(node->bits, node->move.num, steps, 
+        jumps);
+    node->max_depth = 0;
+    node_cost(node);
+    if ((plies == 0) || (node->num_children == 0) || 
+        (black && (node->cost >= best_min)) || 
+        (!black && (node->cost <= best_max))) {
+        return node->cost;
+    }
+    if (black && (node->cost > best_max)) {
+        best_max = node->cost;
+    }
+    else if (!black && (node->cost < best_min)) {
+        best_min = node->cost;
+    }
+
+    /* captures only, made straight from the masks */
+    node_t child;
+    undo_t undo;
+    move_t move;
+    move.num = node->move.num;
+    move.tgt.cell = CELL_EMPTY;
+    for (quad = 0; quad < QUADS; quad++) {
+        for (movers = jumps[quad]; movers; movers &= movers - 1) {
+            src = first_bit(movers);
+            move.src.row = SQ_ROW(src);
+            move.src.col = SQ_COL(src);
+            move.src.cell = bits_cell(node->bits, src);
+            tgt = jump_squares[quad][src];
+            move.tgt.row = SQ_ROW(tgt);
+            move.tgt.col = SQ_COL(tgt);
+            fill_node(&child, node->bits, &move);
+            bits_make_move(node->bits, &child.move, &undo);
+            child_cost = quiesce(search, &child, plies - 1, best_max, 
+                best_min);
+            bits_unmake_move(node->bits, &child.move, &undo);
+            if (black && (child_cost > node->cost)) {
+                node->cost = child_cost;
+                if (node->cost > best_max) {
+                    best_max = node->cost;
+                }
+            }
+            else if (!black && (child_cost < node->cost)) {
+                node->cost = child_cost;
+                if (node->cost < best_min) {
+                    best_min = node->cost;
+                }
+            }
+            if (best_max >= best_min) {
+                return node->cost;
+            }
+        }
+    }
+    return node->cost;
+}
+
+/* fills array with available moves
+*/
+move_t*
+fill_moves_arr(node_t *node, moveset_t *moveset, arena_t *arena) {
+    bits_t steps[QUADS], jumps[QUADS], movers, src_bit;
+    int quad, tgt;
+
+    /* find every legal step and capture at once, then size array exactly */
+    moveset->n_moves = get_move_masks(node->bits, node->move.num, 
+        steps, jumps);
+    moveset->moves_arr = arena_alloc(arena, moveset->n_moves * 
+        sizeof(move_t));
+    moveset->n_moves = 0;
+
+    /* union of all pieces that can move */
+    movers = 0;
+    for (quad = 0; quad < QUADS; quad++) {
+        movers |= steps[quad] | jumps[quad];
+    }
+
+    /* emit moves in row-major order, quadrants in ascending order */
+    move_t cur_move;
+    cur_move.num = node->move.num;
+    cur_move.tgt.cell = CELL_EMPTY;
+    while (movers) {
+        int src = first_bit(movers);
+        src_bit = SQ_BIT(src);
+        movers &= movers - 1;
+        cur_move.src.row = SQ_ROW(src);
+        cur_move.src.col = SQ_COL(src);
+        cur_move.src.cell = bits_cell(node->bits, src);
+
+        for (quad = 0; quad < QUADS; quad++) {
+            if (steps[quad] & src_bit) {
+                tgt = step_squares[quad][src];
+            }
+            else if (jumps[quad] & src_bit) {
+                tgt = jump_squares[quad][src];
+            }
+            else {
+                continue;
+            }
+            cur_move.tgt.row = SQ_ROW(tgt);
+            cur_move.tgt.col = SQ_COL(tgt);
+            moveset->moves_arr[(moveset->n_moves)++] = cur_move;
+        }
+    }
+    return moveset->moves_arr;
+}
+
+/* scores each move so the likeliest best moves are searched first: the hash
+   table move, captures, promotions, killer moves, then by history
+*/
+int*
+score_moves(search_t *search, node_t *node, moveset_t *moveset, 
+    uint8_t hash_move, int ply) {
+    int *scores, i, side = node->move.num % 2;
+    uint8_t packed;
+    move_t *move;
+    scores = arena_alloc(&search->arena, moveset->n_moves * sizeof(int));
+    for (i = 0; i < moveset->n_moves; i++) {
+        move = &moveset->moves_arr[i];
+
+        /* unordered search keeps generated order */
+        if (!search->order_moves) {
+            scores[i] = moveset->n_moves - i;
+            continue;
+        }
+        packed = tt_pack_move(move);
+        scores[i] = search->history[side][packed];
+        if (packed == hash_move) {
+            scores[i] += ORDER_HASH;
+        }
+        if (abs(move->tgt.row - move->src.row) == CAPTURE_JUMP) {
+            scores[i] += ORDER_CAPTURE;
+        }
+        if (((move->src.cell == CELL_BPIECE) && (move->tgt.row == 0)) ||
+            ((move->src.cell == CELL_WPIECE) && (move->tgt.row == ROWS - 1))) {
+            scores[i] += ORDER_PROMOTE;
+        }
+        if ((ply < MAX_PLY) && (packed == search->killers[ply][0])) {
+            scores[i] += ORDER_KILLER;
+        }
+        else if ((ply < MAX_PLY) && (packed == search->killers[ply][1])) {
+            scores[i] += ORDER_KILLER / 2;
+        }
+    }
+    return scores;
+}
+
+/* returns the index of the best scored move not yet searched, marking it
+*/
+int
+pick_move(int *scores, int n_moves) {
+    int i, best = 0;
+    for (i = 1; i < n_moves; i++) {
+        if (scores[i] > scores[best]) {
+            best = i;
+        }
+    }
+    scores[best] = ORDER_DONE;
+    return best;
+}
+
+/* remembers a quiet move that caused a cutoff as a killer for its ply and
+   raises its history score
+*/
+void
+update_order(search_t *search, node_t *node, move_t *move, int depth, 
+    int ply) {
+    if (abs(move->tgt.row - move->src.row) == CAPTURE_JUMP) {
+        return;
+    }
+    uint8_t packed = tt_pack_move(move);
+    if ((ply < MAX_PLY) && (search->killers[ply][0] != packed)) {
+        search->killers[ply][1] = search->killers[ply][0];
+        search->killers[ply][0] = packed;
+    }
+    int *history = &search->history[node->move.num % 2][packed];
+    *history += depth * depth;
+    if (*history > ORDER_HISTORY_MAX) {
+        *history = ORDER_HISTORY_MAX;
+    }
+}
+
+/* halves history scores and clears killers before a new search, as the
+   position has moved on
+*/
+void
+age_order(search_t *search) {
+    int side, i;
+    for (side = 0; side < 2; side++) {
+        for (i = 0; i < PACKED_MOVES; i++) {
+            search->history[side][i] /= 2;
+        }
+    }
+    memset(search->killers, TT_NO_MOVE, sizeof(search->killers));
+}
+
+/* bitboard helper functions -----------------------------------------------*/
+
+/* converts a character board to dark square bitboards
+*/
+void
+board_to_bits(board_t board, bitboard_t *bits) {
+    int sq;
+    char cell;
+    bits->black = bits->white = bits->towers = 0;
+    memset(bits->material, 0, sizeof(bits->material));
+    for (sq = 0; sq < SQUARES; sq++) {
+        cell = board[SQ_ROW(sq)][SQ_COL(sq)];
+        if ((cell == CELL_BPIECE) || (cell == CELL_BTOWER)) {
+            bits->black |= SQ_BIT(sq);
+        }
+        else if ((cell == CELL_WPIECE) || (cell == CELL_WTOWER)) {
+            bits->white |= SQ_BIT(sq);
+        }
+        if ((cell == CELL_BTOWER) || (cell == CELL_WTOWER)) {
+            bits->towers |= SQ_BIT(sq);
+        }
+        if (cell != CELL_EMPTY) {
+            bits->material[bits_type(bits, SQ_BIT(sq))]++;
+        }
+    }
+}
+
+/* returns 1 if no square holds both colours, every tower sits on a piece
+   and no piece waits on the row where it would have become a tower
+*/
+int
+valid_bits(bitboard_t *bits) {
+    return !(bits->black & bits->white) && 
+        !(bits->towers & ~(bits->black | bits->white)) &&
+        !(bits->black & ~bits->towers & TOP_ROW) &&
+        !(bits->white & ~bits->towers & BOTTOM_ROW);
+}
+
+/* returns the board character of a dark square
+*/
+char
+bits_cell(bitboard_t *bits, int square) {
+    bits_t bit = SQ_BIT(square);
+    if (bits->black & bit) {
+        return (bits->towers & bit) ? CELL_BTOWER : CELL_BPIECE;
+    }
+    if (bits->white & bit) {
+        return (bits->towers & bit) ? CELL_WTOWER : CELL_WPIECE;
+    }
+    return CELL_EMPTY;
+}
+
+/* returns the material index of the piece on an occupied square
+*/
+int
+bits_type(bitboard_t *bits, bits_t square_bit) {
+    int tower = (bits->towers & square_bit) != 0;
+    if (bits->black & square_bit) {
+        return tower ? TYPE_BTOWER : TYPE_BPIECE;
+    }
+    return tower ? TYPE_WTOWER : TYPE_WPIECE;
+}
+
+/* moves every set square one step towards a quadrant, dropping squares
+   that would leave the board (row parity decides the shift distance); the
+   mask is shifted within 64 bits, so either direction needs no branch
+*/
+bits_t
+shift_quad(bits_t mask, int quadrant) {
+    const quad_shift_t *shift = &quad_shifts[quadrant - 1];
+    return (bits_t)(((uint64_t)(mask & shift->even_keep) << SQUARES) >> 
+        (SQUARES - shift->even_shift)) | 
+        (bits_t)(((uint64_t)(mask & shift->odd_keep) << SQUARES) >> 
+        (SQUARES - shift->odd_shift));
+}
+
+/* finds, per quadrant, the squares of the player to move that can step or
+   capture in that direction, and returns the total number of moves
+*/
+int
+get_move_masks(bitboard_t *bits, int move_num, bits_t *steps, bits_t *jumps) {
+    bits_t own, enemy, empty, movers, reach;
+    int quad, n_moves = 0;
+
+    /* black moves on even move numbers */
+    if (move_num % 2 == 0) {
+        own = bits->black;
+        enemy = bits->white;
+    }
+    else {
+        own = bits->white;
+        enemy = bits->black;
+    }
+    empty = ~(bits->black | bits->white) & ALL_SQUARES;
+
+    for (quad = QUAD1; quad <= QUAD4; quad++) {
+
+        /* pieces only move forwards, towers move anywhere */
+        movers = own & bits->towers;
+        if (((move_num % 2 == 0) && ((quad == QUAD1) || (quad == QUAD4))) ||
+            ((move_num % 2 != 0) && ((quad == QUAD2) || (quad == QUAD3)))) {
+            movers = own;
+        }
+
+        /* squares whose neighbour is empty, or enemy with empty behind it */
+        reach = shift_quad(empty, OPPOSITE(quad));
+        steps[quad - 1] = movers & reach;
+        jumps[quad - 1] = movers & 
+            shift_quad(reach & enemy, OPPOSITE(quad));
+        n_moves += count_bits(steps[quad - 1]) + count_bits(jumps[quad - 1]);
+    }
+    return n_moves;
+}
+
+/* applies a move to the bitboards, recording what changed so it can be
+   taken back
+*/
+void
+bits_make_move(bitboard_t *bits, move_t *move, undo_t *undo) {
+    bits_t src, tgt, cpt;
+    undo->src = SQUARE(move->src.row, move->src.col);
+    undo->tgt = SQUARE(move->tgt.row, move->tgt.col);
+    src = SQ_BIT(undo->src);
+    tgt = SQ_BIT(undo->tgt);
+    undo->mover = bits_type(bits, src);
+
+    /* move piece and clear old position */
+    if (bits->black & src) {
+        bits->black ^= src | tgt;
+    }
+    else {
+        bits->white ^= src | tgt;
+    }
+    if (bits->towers & src) {
+        bits->towers ^= src | tgt;
+    }
+
+    /* check if a capture was made */
+    undo->cpt = NO_SQUARE;
+    if (abs(move->tgt.row - move->src.row) == CAPTURE_JUMP) {
+
+        /* remove piece from play and from the material count */
+        undo->cpt = SQUARE((move->src.row + move->tgt.row) / 2,
+            (move->src.col + move->tgt.col) / 2);
+        cpt = SQ_BIT(undo->cpt);
+        undo->captured = bits_type(bits, cpt);
+        bits->material[undo->captured]--;
+        cpt = ~cpt;
+        bits->black &= cpt;
+        bits->white &= cpt;
+        bits->towers &= cpt;
+    }
+    undo->promoted = bits_check_tower(bits, move);
+    move->num++;
+}
+
+/* takes back a move made by bits_make_move: demotes a new tower, returns the
+   piece to its source and puts any captured piece back
+*/
+void
+bits_unmake_move(bitboard_t *bits, move_t *move, undo_t *undo) {
+    bits_t src = SQ_BIT(undo->src), tgt = SQ_BIT(undo->tgt), cpt;
+    if (undo->promoted) {
+        bits->material[bits_type(bits, tgt)]--;
+        bits->towers &= ~tgt;
+        bits->material[undo->mover]++;
+    }
+
+    /* move piece back */
+    if (bits->black & tgt) {
+        bits->black ^= src | tgt;
+    }
+    else {
+        bits->white ^= src | tgt;
+    }
+    if (bits->towers & tgt) {
+        bits->towers ^= src | tgt;
+    }
+
+    /* restore captured piece */
+    if (undo->cpt != NO_SQUARE) {
+        cpt = SQ_BIT(undo->cpt);
+        if ((undo->captured == TYPE_BPIECE) || 
+            (undo->captured == TYPE_BTOWER)) {
+            bits->black |= cpt;
+        }
+        else {
+            bits->white |= cpt;
+        }
+        if ((undo->captured == TYPE_BTOWER) || 
+            (undo->captured == TYPE_WTOWER)) {
+            bits->towers |= cpt;
+        }
+        bits->material[undo->captured]++;
+    }
+    move->num--;
+}
+
+/* changes a piece to a tower if it reached the far row, returning 1 if so
+*/
+int
+bits_check_tower(bitboard_t *bits, move_t *move) {
+    bits_t tgt = SQ_BIT(SQUARE(move->tgt.row, move->tgt.col));
+    if (!(tgt & ~bits->towers & ((bits->black & TOP_ROW) | 
+        (bits->white & BOTTOM_ROW)))) {
+        return 0;
+    }
+
+    /* piece becomes a tower, moving it across the material counts */
+    bits->material[bits_type(bits, tgt)]--;
+    bits->towers |= tgt;
+    bits->material[bits_type(bits, tgt)]++;
+    return 1;
+}
+
+/* counts the set squares of a bitboard
+*/
+int
+count_bits(bits_t mask) {
+#ifdef __GNUC__
+    return __builtin_popcount(mask);
+#else
+    int count = 0;
+    while (mask) {
+        mask &= mask - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+/* returns the lowest set square of a non-empty bitboard
+*/
+int
+first_bit(bits_t mask) {
+#ifdef __GNUC__
+    return __builtin_ctz(mask);
+#else
+    int square = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        square++;
+    }
+    return square;
+#endif
+}
+
+/* transposition table helper functions -------------------------------------*/
+
+/* allocates the table and fills the zobrist keys, a size of 0 disables it;
+   returns 0 if the table cannot be allocated
+*/
+int
+tt_init(tt_t *tt, size_t megabytes) {
+    uint64_t state = ZOBRIST_SEED, n_entries = 1;
+    int type, sq;
+    for (type = 0; type < PIECE_TYPES; type++) {
+        for (sq = 0; sq < SQUARES; sq++) {
+            tt->keys[type][sq] = split_mix(&state);
+        }
+    }
+    tt->white_key = split_mix(&state);
+    tt->age = 0;
+    tt->exact_depth = 1;
+    memset(&tt->stats, 0, sizeof(tt->stats));
+    tt->slots = NULL;
+    tt->mask = 0;
+    if (megabytes == 0) {
+        return 1;
+    }
+
+    /* largest power of two number of entries that fits */
+    while (n_entries * 2 * sizeof(tt_slot_t) <= megabytes * MEGABYTE) {
+        n_entries *= 2;
+    }
+    tt->slots = calloc(n_entries, sizeof(tt_slot_t));
+    if (tt->slots == NULL) {
+        return 0;
+    }
+    tt->mask = n_entries - 1;
+    return 1;
+}
+
+/* computes the zobrist hash of a position from scratch
+*/
+uint64_t
+tt_hash(tt_t *tt, bitboard_t *bits, int move_num) {
+    bits_t types[PIECE_TYPES], mask;
+    uint64_t hash = 0;
+    int type;
+    types[TYPE_BPIECE] = bits->black & ~bits->towers;
+    types[TYPE_BTOWER] = bits->black & bits->towers;
+    types[TYPE_WPIECE] = bits->white & ~bits->towers;
+    types[TYPE_WTOWER] = bits->white & bits->towers;
+    for (type = 0; type < PIECE_TYPES; type++) {
+        for (mask = types[type]; mask; mask &= mask - 1) {
+            hash ^= tt->keys[type][first_bit(mask)];
+        }
+    }
+    if (move_num % 2 != 0) {
+        hash ^= tt->white_key;
+    }
+    return hash;
+}
+
+/* updates a hash for the few squares a move changed, and the side to move
+*/
+uint64_t
+tt_update_hash(tt_t *tt, uint64_t hash, undo_t *undo) {
+    int landed = undo->mover;
+    if (undo->promoted) {
+        landed = (undo->mover == TYPE_BPIECE) ? TYPE_BTOWER : TYPE_WTOWER;
+    }
+    hash ^= tt->keys[undo->mover][undo->src] ^ tt->keys[landed][undo->tgt];
+    if (undo->cpt != NO_SQUARE) {
+        hash ^= tt->keys[undo->captured][undo->cpt];
+    }
+    return hash ^ tt->white_key;
+}
+
+/* looks up a position, returning 1 and a copy of its entry if it is stored
+*/
+int
+tt_probe(tt_t *tt, uint64_t hash, tt_entry_t *entry) {
+    if (tt->slots == NULL) {
+        return 0;
+    }
+    tt_slot_t *slot = &tt->slots[hash & tt->mask];
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    uint64_t data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    tt->stats.probes++;
+    tt_unpack_entry(data, entry);
+    if (entry->bound == TT_NONE) {
+        return 0;
+    }
+
+    /* a different position, or a slot half written by another thread */
+    if ((check ^ data) != hash) {
+        tt->stats.collisions++;
+        return 0;
+    }
+    entry->key = hash;
+    tt->stats.hits++;
+    tt->stats.reused += (entry->age != tt->age);
+    return 1;
+}
+
+/* checks if a stored result is deep enough and decides the node for this
+   window, so its score can be returned without searching
+*/
+int
+tt_cutoff(tt_t *tt, tt_entry_t *entry, int depth, int best_max, 
+    int best_min) {
+
+    /* deeper results are only used if the search allows it, otherwise a
+       repeated position could change the move a fixed depth would choose */
+    if ((entry->depth < depth) || 
+        (tt->exact_depth && (entry->depth != depth))) {
+        return 0;
+    }
+
+    /* exact score, or a bound that already falls outside the window */
+    if ((entry->bound == TT_EXACT) || 
+        ((entry->bound == TT_LOWER) && (entry->score >= best_min)) ||
+        ((entry->bound == TT_UPPER) && (entry->score <= best_max))) {
+        tt->stats.cutoffs++;
+        return 1;
+    }
+    return 0;
+}
+
+/* stores a node's result, keeping deeper results from the current search
+*/
+void
+tt_store(tt_t *tt, node_t *node, int depth, int bound) {
+    if (tt->slots == NULL) {
+        return;
+    }
+    tt_slot_t *slot = &tt->slots[node->hash & tt->mask];
+    tt_entry_t entry;
+    uint64_t data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    entry.key = atomic_load_explicit(&slot->check, memory_order_relaxed) ^ 
+        data;
+    tt_unpack_entry(data, &entry);
+
+    /* depth-preferred replacement, stale entries are always replaced */
+    if ((entry.bound != TT_NONE) && (entry.key != node->hash) && 
+        (entry.age == tt->age) && (entry.depth > depth)) {
+        tt->stats.skipped++;
+        return;
+    }
+    if ((entry.bound != TT_NONE) && (entry.key != node->hash)) {
+        tt->stats.replacements++;
+    }
+    tt->stats.stores++;
+    entry.score = node->cost;
+    entry.depth = depth;
+    entry.bound = bound;
+    entry.age = tt->age;
+    entry.move = (node->num_children > 0) ? tt_pack_move(&node->best_move) :
+        TT_NO_MOVE;
+    data = tt_pack_entry(&entry);
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+    atomic_store_explicit(&slot->check, node->hash ^ data, 
+        memory_order_relaxed);
+}
+
+/* packs an entry, without its key, into one word
+*/
+uint64_t
+tt_pack_entry(tt_entry_t *entry) {
+    return (uint64_t)(uint32_t)entry->score | 
+        ((uint64_t)(uint8_t)entry->depth << 32) | 
+        ((uint64_t)entry->bound << 40) | ((uint64_t)entry->age << 48) | 
+        ((uint64_t)entry->move << 56);
+}
+
+/* unpacks a word packed by tt_pack_entry
+*/
+void
+tt_unpack_entry(uint64_t data, tt_entry_t *entry) {
+    entry->score = (int32_t)(uint32_t)data;
+    entry->depth = (int8_t)(data >> 32);
+    entry->bound = (uint8_t)(data >> 40);
+    entry->age = (uint8_t)(data >> 48);
+    entry->move = (uint8_t)(data >> 56);
+}
+
+/* packs a move into one byte: source square, quadrant and capture flag; no
+   legal move packs to TT_NO_MOVE, as square 0 cannot step towards QUAD1
+*/
+uint8_t
+tt_pack_move(move_t *move) {
+    int row_jump = move->tgt.row - move->src.row;
+    int col_jump = move->tgt.col - move->src.col;
+    int quad;
+    if (row_jump < 0) {
+        quad = (col_jump > 0) ? QUAD1 : QUAD4;
+    }
+    else {
+        quad = (col_jump > 0) ? QUAD2 : QUAD3;
+    }
+    return SQUARE(move->src.row, move->src.col) | ((quad - 1) << 5) | 
+        ((abs(row_jump) == CAPTURE_JUMP) << 7);
+}
+
+/* unpacks a move stored by tt_pack_move, returning 0 if there is none
+*/
+int
+tt_unpack_move(uint8_t packed, move_t *move) {
+    if (packed == TT_NO_MOVE) {
+        return 0;
+    }
+    int src = packed & (SQUARES - 1), quad = (packed >> 5) & 3;
+    int tgt = (packed >> 7) ? jump_squares[quad][src] : 
+        step_squares[quad][src];
+    move->src.row = SQ_ROW(src);
+    move->src.col = SQ_COL(src);
+    move->tgt.row = SQ_ROW(tgt);
+    move->tgt.col = SQ_COL(tgt);
+    return 1;
+}
+
+/* prints how the table was used during the last search
+*/
+void
+tt_print_stats(tt_t *tt) {
+    tt_stats_t *stats = &tt->stats;
+    fprintf(stderr, "TT PROBES: %lu HITS: %lu (%.1f%%) CUTOFFS: %lu "
+        "COLLISIONS: %lu STORES: %lu REPLACEMENTS: %lu SKIPPED: %lu "
+        "REUSED: %lu\n", stats->probes, stats->hits, 
+        stats->probes ? 100.0 * stats->hits / stats->probes : 0.0,
+        stats->cutoffs, stats->collisions, stats->stores, 
+        stats->replacements, stats->skipped, stats->reused);
+}
+
+/* empties the table
+*/
+void
+tt_clear(tt_t *tt) {
+    if (tt->slots != NULL) {
+        memset(tt->slots, 0, (tt->mask + 1) * sizeof(tt_slot_t));
+    }
+}
+
+/* returns the table back to the heap
+*/
+void
+tt_free(tt_t *tt) {
+    free(tt->slots);
+    tt->slots = NULL;
+    tt->mask = 0;
+}
+
+/* returns the next number of a fixed seed random sequence (splitmix64)
+*/
+uint64_t
+split_mix(uint64_t *state) {
+    uint64_t z = (*state += ZOBRIST_SEED);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return z ^ (z >> 31);
+}
+
+/* endgame table helper functions -------------------------------------------*/
+
+/* sizes each piece count's table: a position is indexed by its occupied
+   squares, the type on each, then the side to move
+*/
+void
+tb_init(tb_t *tb, int max_pieces) {
+    int n, k, pieces;
+    tb->map = NULL;
+    tb->map_size = 0;
+    tb->max_pieces = max_pieces;
+    for (n = 0; n <= SQUARES; n++) {
+        for (k = 0; k <= TB_MAX_PIECES; k++) {
+            tb->choose[n][k] = (k == 0) ? 1 : (n == 0) ? 0 : 
+                tb->choose[n - 1][k - 1] + tb->choose[n - 1][k];
+        }
+    }
+    tb->offsets[1] = 0;
+    for (pieces = 1; pieces <= max_pieces; pieces++) {
+        tb->offsets[pieces + 1] = tb->offsets[pieces] + 
+            ((uint64_t)tb->choose[SQUARES][pieces] << (2 * pieces + 1));
+    }
+}
+
+/* maps a table file, returning 0 if it cannot be opened or is malformed
+*/
+int
+tb_load(tb_t *tb, char *filename) {
+    struct stat info;
+    uint8_t *map;
+    int fd = open(filename, O_RDONLY), max_pieces = 0, i;
+    if ((fd < 0) || (fstat(fd, &info) < 0) || (info.st_size < TB_HEADER)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    for (i = 0; i < 4; i++) {
+        max_pieces |= map[TB_MAGIC_LEN + i] << (8 * i);
+    }
+    if (memcmp(map, TB_MAGIC, TB_MAGIC_LEN) || (max_pieces < 1) || 
+        (max_pieces > TB_MAX_PIECES)) {
+        munmap(map, info.st_size);
+        return 0;
+    }
+    tb_init(tb, max_pieces);
+    if ((size_t)info.st_size != TB_HEADER + tb->offsets[max_pieces + 1]) {
+        munmap(map, info.st_size);
+        tb->max_pieces = 0;
+        return 0;
+    }
+    tb->map = map;
+    tb->map_size = info.st_size;
+    return 1;
+}
+
+/* returns a position's index, its occupied squares ranked as a combination
+*/
+uint64_t
+tb_index(tb_t *tb, bitboard_t *bits, int move_num) {
+    bits_t occupied = bits->black | bits->white;
+    uint64_t squares = 0, types = 0;
+    int pieces = count_bits(occupied), i = 0, sq;
+    while (occupied) {
+        sq = first_bit(occupied);
+        occupied &= occupied - 1;
+        types |= (uint64_t)bits_type(bits, SQ_BIT(sq)) << (2 * i);
+        squares += tb->choose[sq][++i];
+    }
+    return tb->offsets[pieces] + ((((squares << (2 * pieces)) | types) << 1) |
+        (move_num % 2));
+}
+
+/* sets the bitboards and side to move of a position from its index within
+   the table of its piece count
+*/
+void
+tb_position(tb_t *tb, int pieces, uint64_t index, bitboard_t *bits, 
+    int *move_num) {
+    uint64_t types, squares;
+    int i, sq = SQUARES, type;
+    *move_num = index & 1;
+    index >>= 1;
+    types = index & (((uint64_t)1 << (2 * pieces)) - 1);
+    squares = index >> (2 * pieces);
+    bits->black = bits->white = bits->towers = 0;
+    memset(bits->material, 0, sizeof(bits->material));
+
+    /* highest square first, the largest whose combinations below fit */
+    for (i = pieces; i > 0; i--) {
+        do {
+            sq--;
+        } while (tb->choose[sq][i] > squares);
+        squares -= tb->choose[sq][i];
+        type = (types >> (2 * (i - 1))) & (PIECE_TYPES - 1);
+        if ((type == TYPE_BPIECE) || (type == TYPE_BTOWER)) {
+            bits->black |= SQ_BIT(sq);
+        }
+        else {
+            bits->white |= SQ_BIT(sq);
+        }
+        if ((type == TYPE_BTOWER) || (type == TYPE_WTOWER)) {
+            bits->towers |= SQ_BIT(sq);
+        }
+        bits->material[type]++;
+    }
+}
+
+/* sets a node's cost from the tables and returns 1 if they hold it, a win
+   nearer the game's end costing more than a later one
+*/
+int
+tb_probe(tb_t *tb, node_t *node) {
+    if ((tb->map == NULL) || (count_bits(node->bits->black | 
+        node->bits->white) > tb->max_pieces)) {
+        return 0;
+    }
+    int black = (node->move.num % 2 == 0), moves;
+    uint8_t result = tb->map[TB_HEADER + tb_index(tb, node->bits, 
+        node->move.num)];
+    if (result == TB_DRAW) {
+        node->cost = 0;
+    }
+    else if (result < TB_LOSS) {
+        node->cost = black ? INT_MAX - result : INT_MIN + result;
+    }
+    else {
+        moves = result - TB_LOSS;
+        node->cost = black ? INT_MIN + moves : INT_MAX - moves;
+    }
+    return 1;
+}
+
+/* unmaps the tables
+*/
+void
+tb_free(tb_t *tb) {
+    if (tb->map != NULL) {
+        munmap(tb->map, tb->map_size);
+        tb->map = NULL;
+    }
+}
+
+/* opening book helper functions --------------------------------------------*/
+
+/* maps a book file, returning 0 if it cannot be opened or is malformed
+*/
+int
+book_load(book_t *book, char *filename) {
+    struct stat info;
+    uint8_t *map;
+    uint32_t n_entries = 0;
+    int fd = open(filename, O_RDONLY), i;
+    if ((fd < 0) || (fstat(fd, &info) < 0) || (info.st_size < BOOK_HEADER)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    for (i = 0; i < 4; i++) {
+        n_entries |= (uint32_t)map[BOOK_MAGIC_LEN + i] << (8 * i);
+    }
+    if (memcmp(map, BOOK_MAGIC, BOOK_MAGIC_LEN) || ((size_t)info.st_size != 
+        BOOK_HEADER + (size_t)n_entries * BOOK_ENTRY)) {
+        munmap(map, info.st_size);
+        return 0;
+    }
+    book->map = map;
+    book->map_size = info.st_size;
+    book->n_entries = n_entries;
+    return 1;
+}
+
+/* finds the root's position in the book by binary search and, if its move
+   is legal here, makes it the root's best move and returns 1
+*/
+int
+book_probe(search_t *search, node_t *root) {
+    book_t *book = &search->book;
+    uint32_t low = 0, high = book->n_entries, mid;
+    uint64_t key;
+    uint8_t *entry = NULL;
+    int i;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        entry = book->map + BOOK_HEADER + (size_t)mid * BOOK_ENTRY;
+        key = 0;
+        for (i = 0; i < 8; i++) {
+            key |= (uint64_t)entry[i] << (8 * i);
+        }
+        if (key == root->hash) {
+            break;
+        }
+        if (key < root->hash) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    if (low >= high) {
+        return 0;
+    }
+
+    /* a different position sharing the key would not have this move */
+    arena_mark_t mark = arena_mark(&search->arena);
+    moveset_t moveset;
+    int found = 0;
+    uint32_t cost = 0;
+    fill_moves_arr(root, &moveset, &search->arena);
+    for (i = 0; (i < moveset.n_moves) && !found; i++) {
+        if (tt_pack_move(&moveset.moves_arr[i]) == entry[12]) {
+            root->best_move = moveset.moves_arr[i];
+            found = 1;
+        }
+    }
+    arena_rewind(&search->arena, mark);
+    if (!found) {
+        return 0;
+    }
+    for (i = 0; i < 4; i++) {
+        cost |= (uint32_t)entry[8 + i] << (8 * i);
+    }
+    root->cost = (int32_t)cost;
+    search->completed_depth = entry[13];
+    search->reused_depth = 0;
+    reset_counters(search);
+    return 1;
+}
 
-    /* check if a capture was made */ 
-    if (abs(row2 - row1) == abs(CAPTURE_JUMP)) {
-    
-        /* remove piece from play */
-        board[(row1 + row2) / 2][(col1 + col2) / 2] = CELL_EMPTY;
+/* unmaps the book
+*/
+void
+book_free(book_t *book) {
+    if (book->map != NULL) {
+        munmap(book->map, book->map_size);
+        book->map = NULL;
     }
-    check_tower(board, move);
-    move->num++;
 }
 
-/* changes a piece to a tower if the necessary move is made
+/* arena helper functions ---------------------------------------------------*/
+
+/* prepares an empty arena, blocks are only allocated once needed
 */
 void
-check_tower(board_t board, move_t *move) {
-    char piece;
-    piece = board[move->tgt.row][move->tgt.col];
+arena_init(arena_t *arena) {
+    arena->first = arena->cur = NULL;
+    arena->used = arena->high_water = 0;
+    arena->allocs = 0;
+}
 
-    if (piece == CELL_BTOWER || piece == CELL_WTOWER) {
-        return;
+/* bumps memory from the arena, moving to a new block when the current is full
+*/
+void*
+arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *block = arena->cur, *next;
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+    /* current block is full, reuse the next block or insert a new one */
+    if ((block == NULL) || (block->used + size > block->size)) {
+        next = (block == NULL) ? arena->first : block->next;
+        if ((next == NULL) || (next->size < size)) {
+            size_t block_size = (size > ARENA_BLOCK_SIZE) ? size : 
+                ARENA_BLOCK_SIZE;
+            arena_block_t *new_block;
+            new_block = malloc(sizeof(*new_block) + block_size);
+            assert(new_block != NULL);
+            new_block->size = block_size;
+            new_block->next = next;
+            if (block == NULL) {
+                arena->first = new_block;
+            }
+            else {
+                block->next = new_block;
+            }
+            next = new_block;
+        }
+        next->used = 0;
+        arena->cur = block = next;
     }
 
-    if (piece == CELL_BPIECE && move->tgt.row == 0) {
-        piece = CELL_BTOWER;
-    }
-    else if (piece == CELL_WPIECE && move->tgt.row == ROWS - 1) {
-        piece = CELL_WTOWER;
+    /* hand out memory and track the most ever in use */
+    void *ptr = block->data + block->used;
+    arena->allocs++;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
     }
-    board[move->tgt.row][move->tgt.col] = piece;
+    return ptr;
+}
+
+/* remembers the current arena position
+*/
+arena_mark_t
+arena_mark(arena_t *arena) {
+    arena_mark_t mark;
+    mark.block = arena->cur;
+    mark.block_used = (arena->cur == NULL) ? 0 : arena->cur->used;
+    mark.used = arena->used;
+    return mark;
 }
 
-/* prints information about current board
+/* frees everything allocated since a mark
 */
 void
-print_move_info(board_t board, move_t *move, int cost, int minimax_move) {
-    int row1, row2;
-    char col1, col2;
+arena_rewind(arena_t *arena, arena_mark_t mark) {
+    arena->cur = mark.block;
+    if (arena->cur != NULL) {
+        arena->cur->used = mark.block_used;
+    }
+    arena->used = mark.used;
+}
 
-    /* convert index values to output values */
-    row1 = move->src.row + 1;
-    row2 = move->tgt.row + 1;
-    col1 = n2a(move->src.col);
-    col2 = n2a(move->tgt.col);
+/* frees everything in the arena at once, keeping its blocks for reuse
+*/
+void
+arena_reset(arena_t *arena) {
+    arena->cur = NULL;
+    arena->used = 0;
+}
 
-    /* delimiter */
-    printf("=====================================\n");
-    if (minimax_move) {
-        printf("*** ");
+/* returns the arena's blocks back to the heap
+*/
+void
+arena_free(arena_t *arena) {
+    arena_block_t *block = arena->first, *next;
+    while (block != NULL) {
+        next = block->next;
+        free(block);
+        block = next;
     }
-    if ((move->num % 2) == 0) {
-        printf("WHITE ACTION #%d: %c%d-%c%d\n", move->num, 
-            col1, row1, col2, row2);
+    arena_init(arena);
+}
+
+/* input helper functions ---------------------------------------------------*/
+
+/* holds a whole file in memory by mapping it, or stdin by reading it in
+   blocks, exiting if the file cannot be opened
+*/
+void
+read_input(char *filename, input_t *input) {
+    struct stat info;
+    size_t max_length = INPUT_BLOCK, n_read;
+    input->length = input->pos = 0;
+    input->line_num = 0;
+    input->mapped = 0;
+
+    /* map the file, an empty one has nothing to map */
+    if (filename != NULL) {
+        int fd = open(filename, O_RDONLY);
+        if ((fd < 0) || (fstat(fd, &info) < 0)) {
+            fprintf(stderr, "cannot open input file %s\n", filename);
+            exit(EXIT_FAILURE);
+        }
+        input->text = NULL;
+        input->length = info.st_size;
+        if (input->length > 0) {
+            input->text = mmap(NULL, input->length, PROT_READ, MAP_PRIVATE, 
+                fd, 0);
+            assert(input->text != MAP_FAILED);
+            input->mapped = 1;
+        }
+        close(fd);
+        return;
     }
-    else {
-        printf("BLACK ACTION #%d: %c%d-%c%d\n", move->num, 
-            col1, row1, col2, row2);
 
+    /* read stdin a block at a time, growing the buffer as needed */
+    input->text = malloc(max_length);
+    assert(input->text != NULL);
+    while ((n_read = fread(input->text + input->length, 1, 
+        max_length - input->length, stdin)) > 0) {
+        input->length += n_read;
+        if (input->length == max_length) {
+            max_length *= 2;
+            input->text = realloc(input->text, max_length);
+            assert(input->text != NULL);
+        }
     }
-    printf("BOARD COST: %d\n", cost);
 }
 
-/* calculates cost of the board
+/* splits off the next line of input, without its newline, returning 0 once
+   none are left
 */
 int
-node_cost(node_t* node) {
-
-    /* determine if previous move ended the game */
-    if (node->max_depth) {
-        
-        /* check if other player has moves in current state */
-        moveset_t *moveset;
-        moveset = (moveset_t*)malloc(sizeof(moveset_t));
-        moveset->moves_arr = fill_moves_arr(node, moveset);
-        node->num_children = moveset->n_moves;
-    
-        /* free used memory*/
-        free(moveset->moves_arr);
-        moveset->moves_arr = NULL;
-        free(moveset);
-        moveset = NULL;
+next_line(input_t *input, char **line, int *length) {
+    if (input->pos >= input->length) {
+        return 0;
     }
+    char *start = input->text + input->pos, *newline;
+    newline = memchr(start, '\n', input->length - input->pos);
+    *line = start;
+    *length = (newline == NULL) ? (int)(input->length - input->pos) : 
+        (int)(newline - start);
+    input->pos += *length + 1;
+    input->line_num++;
+    return 1;
+}
 
-    /* player has no available moves */ 
-    if (node->num_children == 0) {
-
-        /* black to move, they lose */
-        if (node->move.num % 2 == 0) {  
-            node->cost = INT_MIN;
+/* reads a move such as C6-D5 from a line, returning 0 if it holds none
+*/
+int
+parse_move(char *line, int length, move_t *move) {
+    int i = 0, nums[2], n;
+    char chars[2];
+
+    /* column character then row number, either side of the dash */
+    for (n = 0; n < 2; n++) {
+        while ((i < length) && isspace((unsigned char)line[i])) {
+            i++;
         }
-
-        /* white to move, they lose */
-        else {
-            node->cost = INT_MAX;
+        if ((i == length) || ((n == 1) && (line[i++] != '-')) || 
+            (i == length)) {
+            return 0;
+        }
+        chars[n] = line[i++];
+        if ((i == length) || !isdigit((unsigned char)line[i])) {
+            return 0;
+        }
+        /* a number already past the board stays off it, however long */
+        for (nums[n] = 0; (i < length) && isdigit((unsigned char)line[i]);
+            i++) {
+            if (nums[n] <= ROWS) {
+                nums[n] = 10 * nums[n] + (line[i] - '0');
+            }
         }
-        return node->cost;
     }
 
-    /* game did not end, calculate cost */
-    node->cost = cost(node->board);
-    return node->cost;
+    /* nothing but spaces may follow */
+    if (!blank_line(line + i, length - i)) {
+        return 0;
+    }
+    move->src.row = nums[0] - 1;
+    move->tgt.row = nums[1] - 1;
+    move->src.col = a2n(chars[0]);
+    move->tgt.col = a2n(chars[1]);
+    return 1;
 }
 
-/* sums the total cost of the board
+/* returns the command a line holds, or 0 if it holds none
 */
 int
-cost(board_t board) {
-    int row, col, cost, i, j;
-    char piece;
-    int bP = 0, bT = 0, wP = 0, wT = 0;
-
-    /* sum cost of all pieces */
-    for (i = 0; i < ROWS; i++) {
-        row = i;
-        for (j = 0; j < COLS; j++) {
-            col = j;
-            piece = board[row][col];
+parse_command(char *line, int length) {
+    while ((length > 0) && isspace((unsigned char)line[length - 1])) {
+        length--;
+    }
+    while ((length > 0) && isspace((unsigned char)*line)) {
+        line++;
+        length--;
+    }
+    if ((length == 1) && ((*line == ACTION) || (*line == PLAY))) {
+        return *line;
+    }
+    return 0;
+}
 
-            /* add value of piece */
-            if (piece == CELL_BPIECE) {
-                bP++;
-            }
-            else if (piece == CELL_BTOWER) {
-                bT++;
-            }
-            else if (piece == CELL_WPIECE) {
-                wP++;
-            }
-            else if (piece == CELL_WTOWER) {
-                wT++;
-            }
+/* checks if a line holds only spaces
+*/
+int
+blank_line(char *line, int length) {
+    int i;
+    for (i = 0; i < length; i++) {
+        if (!isspace((unsigned char)line[i])) {
+            return 0;
         }
     }
-
-    /* calculate cost according to formula */
-    cost = ((bP * COST_PIECE) + (bT * COST_TOWER) - (wP * COST_PIECE) - 
-        (wT * COST_TOWER));
-    return cost;
+    return 1;
 }
 
-/* ends the game if player wins
+/* returns the input's memory
 */
 void
-check_winner(node_t *node) {
-    if (node->cost == INT_MAX) {
-        printf("BLACK WIN!\n");
-        free_tree(node);
-        exit(EXIT_SUCCESS);
-    }
-    else if (node->cost == INT_MIN) {
-        printf("WHITE WIN!\n");
-        free_tree(node);
-        exit(EXIT_SUCCESS);
+free_input(input_t *input) {
+    if (input->mapped) {
+        munmap(input->text, input->length);
     }
     else {
-        return;
+        free(input->text);
     }
+    input->text = NULL;
 }
 
-/* stage 1 & 2 helper functions ----------------------------------------------*/
+/* game record helper functions ---------------------------------------------*/
 
-/* fills minimax tree with possible board outcomes 
+/* starts an empty record of a game from the standard board
 */
 void
-fill_tree(node_t *node, int depth) {
-    
-    /* assign leaf node data */
-    if (depth == 0) {
-        node->max_depth = 1;
-        node->cost = node_cost(node);
-        node->num_children = 0; // reset after calculating cost (avoid segfault)
-        return;
-    }    
+record_init(record_t *record) {
+    record->has_position = 0;
+    record->move_num = 0;
+    record->command = '\0';
+    record->result = RESULT_NONE;
+    record->moves = NULL;
+    record->n_moves = record->max_moves = 0;
+}
 
-    /* allocate and generate a moveset for this node */
-    moveset_t *moveset;
-    moveset = malloc(sizeof(*moveset));
-    assert(moveset != NULL);
-    moveset->moves_arr = fill_moves_arr(node, moveset);
-    node->num_children = moveset->n_moves;
-    
-    /* no moves can be made */
-    if (node->num_children == 0) {
-        node->cost = node_cost(node);
-        free(moveset->moves_arr);
-        moveset->moves_arr = NULL;
-        free(moveset);
-        moveset = NULL;
-        return;
+/* adds a move to the record, one byte as packed for the hash table
+*/
+void
+record_move(record_t *record, move_t *move) {
+    if (record->n_moves == record->max_moves) {
+        record->max_moves = record->max_moves ? 2 * record->max_moves : 
+            INPUT_BLOCK;
+        record->moves = realloc(record->moves, record->max_moves);
+        assert(record->moves != NULL);
     }
-
-    /* assign number of children based on possible moves */
-    node->children = (node_t**)malloc(node->num_children * sizeof(node_t*));
-    assert(node->children != NULL);
-    
-    /* create a new child for each move */
-    int i;
-    for (i = 0; i < node->num_children; i++) {
-        
-        /* create child node */
-        node_t *child;
-        child = make_empty_node();
-        fill_node(child, node->board, &moveset->moves_arr[i]);
-        make_move(child->board, &child->move);
-        node->children[i] = child;
-       
-        /* find possible moves for each child node */
-        fill_tree(child, depth - 1);
-    }
-    free(moveset->moves_arr);
-    moveset->moves_arr = NULL;
-    free(moveset);
-    moveset = NULL;
+    record->moves[record->n_moves++] = tt_pack_move(move);
 }
 
-/* fills array with available moves
+/* decodes the input if it is a binary record, returning 1 if so; the header
+   is the magic, flags, command, result and move count (little-endian),
+   followed by the position when flagged and then one byte per move
 */
-move_t*
-fill_moves_arr(node_t *node, moveset_t *moveset) {
-
-    /* initialise counters for array of moves */
-    moveset->n_moves = 0;
-    moveset->max_moves = MAX_TOWER_MOVES;
-    
-    /* get memory for array of moves */
-    moveset->moves_arr = (move_t*)malloc(moveset->max_moves * sizeof(move_t));
-    assert(moveset->moves_arr != NULL);
-    
-    /* find possible moves for each cell (row-major order) */
-    int i, j;
-    cell_t src_cell;
-    for (i = 0; i < ROWS; i++) {
-        src_cell.row = i;
-        for (j = 0; j < COLS; j++) {
-            src_cell.col = j;
-            src_cell.cell = node->board[i][j];
-
-            /* store moves for this cell in array */
-            if (src_cell.cell != CELL_EMPTY) {
-                moveset->moves_arr = get_moves(node, &src_cell, moveset);
-            }           
+int
+read_record(input_t *input, record_t *record) {
+    uint8_t *bytes = (uint8_t*)input->text;
+    size_t length = input->length, pos = RECORD_HEADER;
+    uint32_t n_moves;
+    int i;
+    if ((length < RECORD_HEADER) || 
+        (memcmp(bytes, RECORD_MAGIC, RECORD_MAGIC_LEN) != 0)) {
+        return 0;
+    }
+    record_init(record);
+    record->has_position = bytes[4] & RECORD_HAS_POSITION;
+    record->command = bytes[5];
+    record->result = bytes[6];
+    n_moves = bytes[8] | (bytes[9] << 8) | (bytes[10] << 16) | 
+        ((uint32_t)bytes[11] << 24);
+
+    /* optional starting position, counts come from the boards */
+    if (record->has_position) {
+        if (length < pos + RECORD_POSITION) {
+            fprintf(stderr, "game record is truncated\n");
+            exit(EXIT_FAILURE);
+        }
+        bits_t *boards[] = {&record->bits.black, &record->bits.white, 
+            &record->bits.towers};
+        for (i = 0; i < 3; i++, pos += 4) {
+            *boards[i] = bytes[pos] | (bytes[pos + 1] << 8) | 
+                (bytes[pos + 2] << 16) | ((bits_t)bytes[pos + 3] << 24);
+        }
+        record->move_num = bytes[pos] | (bytes[pos + 1] << 8);
+        pos += 2;
+        if (!valid_bits(&record->bits)) {
+            fprintf(stderr, "game record has an impossible position\n");
+            exit(EXIT_FAILURE);
         }
     }
-    return moveset->moves_arr;
+    /* the count is unsigned and checked before it becomes an int */
+    if (n_moves > length - pos) {
+        fprintf(stderr, "game record is truncated\n");
+        exit(EXIT_FAILURE);
+    }
+    record->n_moves = n_moves;
+    record->moves = malloc(record->n_moves + 1);
+    assert(record->moves != NULL);
+    memcpy(record->moves, bytes + pos, record->n_moves);
+    record->max_moves = record->n_moves + 1;
+    return 1;
 }
 
-/* adds moves for an individual cell to array
+/* writes a record in the layout read by read_record, returning 0 without
+   writing if its move number does not fit the record's 16 bits
 */
-move_t*
-get_moves(node_t *node, cell_t *src_cell, moveset_t *moveset) {
-
-    /* initialise move */
-    move_t cur_move; 
-    cur_move.src = *src_cell;
-    cur_move.tgt = *src_cell;
-    cur_move.num = node->move.num; 
-
-    /* moves for black piece */
-    if (cur_move.src.cell == CELL_BPIECE) {
-
-        /* check top right and left moves (1st and 4th quadrants) */
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD1, moveset);
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD4, moveset);
-    return moveset->moves_arr;
+int
+write_record(record_t *record, FILE *fp) {
+    uint8_t header[RECORD_HEADER + RECORD_POSITION], *pos = header;
+    bits_t boards[] = {record->bits.black, record->bits.white, 
+        record->bits.towers};
+    int i, j;
+    if (record->has_position && ((record->move_num < 0) || 
+        (record->move_num > RECORD_MAX_MOVE_NUM))) {
+        return 0;
     }
-
-    /* moves for white piece */
-    else if (cur_move.src.cell == CELL_WPIECE) {
-
-        /* check bottom left and right moves (2nd and 3rd quadrants) */
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD2, moveset);
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD3, moveset);
-    return moveset->moves_arr;
+    memcpy(pos, RECORD_MAGIC, RECORD_MAGIC_LEN);
+    pos[4] = record->has_position ? RECORD_HAS_POSITION : 0;
+    pos[5] = record->command;
+    pos[6] = record->result;
+    pos[7] = 0;
+    for (i = 0; i < 4; i++) {
+        pos[8 + i] = (uint32_t)record->n_moves >> (8 * i);
     }
-
-    /* moves for any tower */ 
-    else {
-
-        /* check all four quadrants */
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD1, moveset);
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD2, moveset);
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD3, moveset);
-        moveset->moves_arr = get_move(node->board, &cur_move, QUAD4, moveset);
-    }    
-    return moveset->moves_arr;
+    pos += RECORD_HEADER;
+    if (record->has_position) {
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 4; j++) {
+                *pos++ = boards[i] >> (8 * j);
+            }
+        }
+        *pos++ = record->move_num;
+        *pos++ = record->move_num >> 8;
+    }
+    fwrite(header, 1, pos - header, fp);
+    fwrite(record->moves, 1, record->n_moves, fp);
+    return 1;
 }
 
-/* adds legal move to an array of moves
+/* prints a record's moves and command as text, or packs text moves into a
+   record, replaying either so it exits at an illegal or malformed move
 */
-move_t*
-get_move(board_t board, move_t *move, int quadrant, moveset_t *moveset) {
-    int i, jump;
-    for (i = 1; i <= CAPTURE_JUMP; i++) {
-        jump = i;
-
-        /* check upper right move */
-        if (quadrant == 1) {
-            move->tgt.row = move->src.row - jump;
-            move->tgt.col = move->src.col + jump; 
-            move->tgt.cell = board[move->tgt.row][move->tgt.col];
-            if (illegal_move(board, move)) {
-                continue;
-            }   
+void
+convert_input(input_t *input) {
+    record_t record;
+    move_t move;
+    board_t board;
+    char *line;
+    int i, length, error;
+
+    /* record to text, one move per line after any position */
+    char position[POSITION_TEXT];
+    if (read_record(input, &record)) {
+        set_board(board);
+        move.num = 0;
+        if (record.has_position) {
+            bits_to_board(&record.bits, board);
+            move.num = record.move_num;
+            format_position(board, record.move_num, position);
+            printf("%s\n", position);
         }
-
-        /* check bottom right move */
-        else if (quadrant == 2) {
-            move->tgt.row = move->src.row + jump;
-            move->tgt.col = move->src.col + jump;
-            move->tgt.cell = board[move->tgt.row][move->tgt.col];
-            if (illegal_move(board, move)) {
-                continue;
+        for (i = 0; i < record.n_moves; i++) {
+            if (!tt_unpack_move(record.moves[i], &move)) {
+                fprintf(stderr, "move %d of the record is empty\n", i + 1);
+                exit(EXIT_FAILURE);
+            }
+            set_move_cells(board, &move);
+            error = illegal_move(board, &move);
+            if (error) {
+                fprintf(stderr, "move %d of the record: ", i + 1);
+                fflush(stderr);
+                print_error(error);
+                exit(EXIT_FAILURE);
             }
+            make_move(board, &move);
+            printf("%c%d-%c%d\n", n2a(move.src.col), move.src.row + 1, 
+                n2a(move.tgt.col), move.tgt.row + 1);
         }
-
-        /* check bottom left move */
-        else if (quadrant == 3) {
-            move->tgt.row = move->src.row + jump;
-            move->tgt.col = move->src.col - jump;
-            move->tgt.cell = board[move->tgt.row][move->tgt.col];
-            if (illegal_move(board, move)) {
-                continue;
-            }   
+        if (record.command) {
+            printf("%c\n", record.command);
         }
+        free_record(&record);
+        return;
+    }
 
-        /* check top right move */
-        else {
-            move->tgt.row = move->src.row - jump;
-            move->tgt.col = move->src.col - jump;
-            move->tgt.cell = board[move->tgt.row][move->tgt.col];
-            if (illegal_move(board, move)) {
-                continue;
-            }   
+    /* text to record, replaying the moves so only legal ones are packed */
+    record_init(&record);
+    set_board(board);
+    move.num = 0;
+    if (read_position(input, board, &move.num)) {
+        record.has_position = 1;
+        board_to_bits(board, &record.bits);
+        record.move_num = move.num;
+    }
+    while (next_line(input, &line, &length)) {
+        if (parse_move(line, length, &move)) {
+            set_move_cells(board, &move);
+            error = illegal_move(board, &move);
+            if (error) {
+                fprintf(stderr, "line %d: ", input->line_num);
+                fflush(stderr);
+                print_error(error);
+                exit(EXIT_FAILURE);
+            }
+            record_move(&record, &move);
+            make_move(board, &move);
+        }
+        else if (parse_command(line, length)) {
+            record.command = parse_command(line, length);
+            break;
+        }
+        else if (!blank_line(line, length)) {
+            fprintf(stderr, "line %d: malformed move \"%.*s\"\n", 
+                input->line_num, length, line);
+            exit(EXIT_FAILURE);
         }
-
-        /* add move to moves array if legal */
-        if (!illegal_move(board, move)) {
-            moveset->moves_arr[(moveset->n_moves)++] = *move;
-            moveset->moves_arr = realloc_moves_arr(moveset);
-            return moveset->moves_arr;
-        }  
     }
-    return moveset->moves_arr;
+    if (!write_record(&record, stdout)) {
+        fprintf(stderr, "cannot write the record\n");
+        exit(EXIT_FAILURE);
+    }
+    free_record(&record);
 }
 
-/* resizes and reallocates memory for array of moves
+/* converts dark square bitboards to a character board
 */
-move_t*
-realloc_moves_arr(moveset_t *moveset) {
-
-    /* array reached maximum capacity */
-    if (moveset->n_moves == moveset->max_moves) {
-
-        /* reallocate array with 2x size */
-        moveset->max_moves *= 2;
-        moveset->moves_arr = (move_t*)realloc(moveset->moves_arr, 
-            (moveset->max_moves * sizeof(move_t)));
-        assert(moveset->moves_arr != NULL);
+void
+bits_to_board(bitboard_t *bits, board_t board) {
+    int row, col;
+    for (row = 0; row < ROWS; row++) {
+        for (col = 0; col < COLS; col++) {
+            board[row][col] = CELL_EMPTY;
+            if ((row + col) % 2 != 0) {
+                board[row][col] = bits_cell(bits, SQUARE(row, col));
+            }
+        }
     }
-    return moveset->moves_arr;      
 }
 
-/* find best move using minimax algorithm and alpha-beta pruning
+/* returns a record's moves to the heap
 */
-int 
-minimax_cost(node_t *node, int best_max, int best_min) {
+void
+free_record(record_t *record) {
+    free(record->moves);
+    record->moves = NULL;
+    record->n_moves = record->max_moves = 0;
+}
 
-    /* base case - reach leaf node and return cost */
-    if (node->num_children == 0) {
-        node->propagated_cost = node->cost;
-        return node->cost;
-    }
- 
-    /* black to move, maximising cost */
-    int i;
-    if (node->move.num % 2 == 0) {
+/* position string helper functions -----------------------------------------*/
 
-        /* assume losing position and find better child nodes */
-        node->cost = INT_MIN;
-        for (i = 0; i < node->num_children; i++) {
-            
-            /* recurse to base case - get leaf node cost */
-            node->temp_cost = minimax_cost(node->children[i], 
-                best_max, best_min);
+/* reads a position string into the board and the number of moves made,
+   returning 0 and leaving the board unchanged if it is malformed; dark
+   squares are listed row by row from row 1, each row ended by a slash
+   except the last, then the side to move and the next action's number,
+   from 1 to MAX_ACTION_NUM
+*/
+int
+parse_position(char *text, int length, board_t board, int *move_num) {
+    char copy[POSITION_TEXT], *squares, side, *cell;
+    board_t parsed;
+    bitboard_t bits;
+    int row, col, number, end = 0;
+    if (length >= POSITION_TEXT) {
+        return 0;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    squares = copy;
+    while (isspace((unsigned char)*squares)) {
+        squares++;
+    }
 
-            /* update node if child cost is better than current cost */
-            if (node->temp_cost > node->cost) {
-                node->cost = node->temp_cost;
-                node->best_child = i;               
-                best_max = node->cost;
+    /* one character per dark square, a board character */
+    for (row = 0; row < ROWS; row++) {
+        for (col = 0; col < COLS; col++) {
+            parsed[row][col] = CELL_EMPTY;
+            if ((row + col) % 2 == 0) {
+                continue;
             }
-
-            /* white has a better move, don't need to compute further costs */ 
-            if (best_min <= best_max) {
-                break;
+            cell = strchr((char[]){CELL_EMPTY, CELL_BPIECE, CELL_WPIECE, 
+                CELL_BTOWER, CELL_WTOWER, '\0'}, *squares);
+            if ((*squares == '\0') || (cell == NULL)) {
+                return 0;
             }
-        } 
-
-        /* all children lead to losing position, choose first one */
-        if (node->cost == INT_MIN) {
-            node->best_child = 0;
-
+            parsed[row][col] = *squares++;
+        }
+        if ((row < ROWS - 1) && (*squares++ != ROW_DELIM)) {
+            return 0;
         }
     }
 
-    /* white to move, minimising cost */ 
-    else {
-
-        /* assume losing position and find better child nodes */
-        node->cost = INT_MAX;
-        for (i = 0; i < node->num_children; i++) {
-
-            /* recurse to base case - get leaf node cost */
-            node->temp_cost = minimax_cost(node->children[i], 
-                best_max, best_min);
+    /* side to move must agree with the action number's parity, the width
+       stops sscanf before a long number could overflow */
+    if ((sscanf(squares, " %c %" ACTION_NUM_DIGITS "d %n", &side, &number, 
+        &end) != 2) || (squares[end] != '\0') || (number < 1) || 
+        (number > MAX_ACTION_NUM) || 
+        ((side != SIDE_BLACK) && (side != SIDE_WHITE)) ||
+        ((side == SIDE_BLACK) != (number % 2 == 1))) {
+        return 0;
+    }
+    board_to_bits(parsed, &bits);
+    if (!valid_bits(&bits)) {
+        return 0;
+    }
+    memcpy(board, parsed, sizeof(parsed));
+    *move_num = number - 1;
+    return 1;
+}
 
-            /* update node if child cost is better than current cost */
-            if (node->temp_cost < node->cost) {
-                node->cost = node->temp_cost;
-                node->best_child = i; 
-                best_min = node->cost;
-            }
+/* takes a position from the first non-blank line of input if it holds one,
+   returning 1 if so and otherwise leaving the input where it was
+*/
+int
+read_position(input_t *input, board_t board, int *move_num) {
+    size_t pos = input->pos;
+    int line_num = input->line_num, length;
+    char *line;
+    while (next_line(input, &line, &length)) {
+        if (blank_line(line, length)) {
+            continue;
+        }
+        if (parse_position(line, length, board, move_num)) {
+            return 1;
+        }
+        break;
+    }
+    input->pos = pos;
+    input->line_num = line_num;
+    return 0;
+}
 
-            /* black has a better move, don't need to compute further costs */ 
-            if (best_min <= best_max) {
-                break;
+/* writes the position string of a board, given the number of moves made
+*/
+void
+format_position(board_t board, int move_num, char *text) {
+    char *start = text;
+    int row, col;
+    for (row = 0; row < ROWS; row++) {
+        for (col = 0; col < COLS; col++) {
+            if ((row + col) % 2 != 0) {
+                *text++ = board[row][col];
             }
-        }  
-
-        /* all children lead to losing position, choose first one */
-        if (node->cost == INT_MAX) {
-            node->best_child = 0;
-        }      
+        }
+        if (row < ROWS - 1) {
+            *text++ = ROW_DELIM;
+        }
     }
-    return node->cost;
+    snprintf(text, POSITION_TEXT - (text - start), " %c %d", 
+        (move_num % 2 == 0) ? SIDE_BLACK : SIDE_WHITE, move_num + 1);
 }
 
 /* miscellaneous helper functions --------------------------------------------*/
 
-/* copies one board to another
+/* returns milliseconds on a monotonic clock
 */
-void 
-copy_board(board_t original, board_t copy) {
-    int i, j;
-    for (i = 0; i < ROWS; i++) {
-        for (j = 0; j < COLS; j++) {
-            copy[i][j] = original[i][j];
-        }
-    }
+long
+now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+/* returns nanoseconds on a monotonic clock
+*/
+long
+now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/* checks if a coordinate lies inside the board
+*/
+int
+on_board(int row, int col) {
+    return (row >= 0) && (row < ROWS) && (col >= 0) && (col < COLS);
 }
 
 /* converts column letter to its number equivalent 